@@ -0,0 +1,477 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2025, Michael VanLoon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ATOMICSLAB_HPP_
+#define ATOMICSLAB_HPP_
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+#include "helper.hpp"
+#include "spinlock.hpp"
+#include "pagemap.hpp"
+#include "slab.hpp"
+
+
+namespace spallocator
+{
+
+    //
+    // AtomicSlab is a lock-free slab engine with the same interface as
+    // Slab<ElemSize>. Each span's slot bitmap is an array of
+    // std::atomic<uint64_t>: allocation claims a clear bit with a CAS and
+    // deallocation releases it with fetch_and, so threads allocating from
+    // and freeing to the same size class never wait for each other. Only
+    // mapping a new span takes a lock.
+    //
+    // Spans are appended to a singly-linked list that is only ever
+    // extended, so readers can walk it without synchronization beyond the
+    // acquire loads of the links. Allocation starts at a hint (the span
+    // that last satisfied a request, or a lower one that just had a slot
+    // freed) and wraps around the list once before growing it.
+    //
+    // The trade-offs: a full size class scans every span's words before
+    // growing, spans are never returned to the OS (a span can't be
+    // unmapped while another thread may be CASing its bitmap), and all
+    // threads contend on the same bitmap cache lines.
+    //
+    template<const std::size_t ElemSize, Lockable Lock = SpinLock>
+    class AtomicSlab: public AbstractSlab
+    {
+    public: // methods
+        std::byte* allocateItem(std::size_t size);
+        void deallocateItem(std::byte* item);
+
+        std::size_t allocateBatch(std::size_t size, std::span<std::byte*> items);
+        void deallocateBatch(std::span<std::byte* const> items);
+
+        // the lock only guards growth
+        LockStatsSnapshot lockStats() const
+        {
+            if constexpr (requires { grow_lock.stats(); })
+            {
+                return grow_lock.stats();
+            }
+            return {};
+        }
+
+        // Lock-free like allocation; slots claimed or released during the
+        // walk may or may not be counted. Spans are never released, so the
+        // peak is the current size.
+        SlabUsage usage();
+
+        constexpr std::size_t getElemSize() const { return ElemSize; }
+        constexpr std::size_t getAllocSize() const { return slab_alloc_size; }
+        static constexpr std::size_t getItemsPerSlab() { return items_per_slab; }
+        std::size_t getAllocatedMemory() const
+        {
+            return span_count.load(std::memory_order_relaxed) * slab_alloc_size;
+        }
+
+        explicit AtomicSlab(const PagePolicy& policy = {});
+        virtual ~AtomicSlab();
+
+    private: // methods
+        AtomicSlab(const AtomicSlab&) = delete;
+        AtomicSlab& operator=(const AtomicSlab&) = delete;
+        AtomicSlab(AtomicSlab&&) = delete;
+        AtomicSlab& operator=(AtomicSlab&&) = delete;
+
+    private: // types
+        static constexpr std::size_t slab_alloc_size{selectBufferSize<ElemSize>()};
+        static constexpr std::size_t max_items{slab_alloc_size / ElemSize};
+        static constexpr std::size_t bits_per_word{64};
+        static constexpr std::size_t word_count{(max_items + bits_per_word - 1) / bits_per_word};
+
+        struct Span: SpanHeader
+        {
+            std::atomic<Span*> next{nullptr};
+            // one bit per slot, 1 = allocated; bits past items_per_slab
+            // are set for good
+            std::array<std::atomic<uint64_t>, word_count> slots{};
+        };
+
+    private: // methods
+        std::byte* itemsStart(Span* span) const
+        {
+            return reinterpret_cast<std::byte*>(span) + data_offset;
+        }
+
+        // see Slab::locateItem()
+        std::pair<Span*, std::size_t> locateItem(std::byte* item) const;
+
+        // Claim free slots from `span`, at most items.size(); returns the
+        // number claimed
+        std::size_t claimFromSpan(Span* span, std::span<std::byte*> items);
+        // Claim at least one slot, growing the slab if every span is full
+        std::size_t claim(std::span<std::byte*> items);
+        void grow(std::size_t seen_spans);
+
+        void releaseItem(std::byte* item);
+
+    private: // data members
+        static constexpr std::size_t data_offset{spanDataOffset(sizeof(Span), ElemSize)};
+        static constexpr std::size_t items_per_slab{(slab_alloc_size - data_offset) / ElemSize};
+        static_assert(items_per_slab >= 4, "Span must hold at least four items");
+        static_assert(data_offset <= spanDataOffset(spanHeaderBound(max_items), ElemSize),
+            "Span header exceeds the bound selectBufferSize() sized the span for");
+        static constexpr std::size_t max_slabs{4_GB / slab_alloc_size};
+
+        std::atomic<Span*> first{nullptr};
+        std::atomic<Span*> hint{nullptr};
+        std::atomic<std::size_t> span_count{0};
+        Span* last{nullptr};            // guarded by grow_lock
+        PagePolicy page_policy;
+
+        Lock grow_lock;
+    };
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::byte* AtomicSlab<ElemSize, Lock>::allocateItem(std::size_t size)
+    {
+        runtime_assert(size <= ElemSize, [&] {
+            return std::format("Requested size {} exceeds slab element size {}", size, ElemSize);
+        });
+
+        std::byte* item = nullptr;
+        claim(std::span<std::byte*>(&item, 1));
+        return item;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t AtomicSlab<ElemSize, Lock>::allocateBatch(std::size_t size, std::span<std::byte*> items)
+    {
+        runtime_assert(size <= ElemSize, [&] {
+            return std::format("Requested size {} exceeds slab element size {}", size, ElemSize);
+        });
+
+        std::size_t count = 0;
+        try
+        {
+            while (count < items.size())
+            {
+                count += claim(items.subspan(count));
+            }
+        }
+        catch (const std::out_of_range&)
+        {
+            // exhausted part way through; hand back what we did get
+            if (count == 0)
+            {
+                throw;
+            }
+        }
+        return count;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t AtomicSlab<ElemSize, Lock>::claimFromSpan(Span* span, std::span<std::byte*> items)
+    {
+        std::size_t count = 0;
+        std::byte* items_start = itemsStart(span);
+        for (std::size_t w = 0; w < word_count && count < items.size(); ++w)
+        {
+            auto& word = span->slots[w];
+            uint64_t old = word.load(std::memory_order_relaxed);
+            uint64_t take = 0;
+            while (old != ~uint64_t{0})
+            {
+                // the lowest clear bits, as many as are still wanted
+                take = 0;
+                uint64_t free = ~old;
+                for (std::size_t n = count; n < items.size() && free; ++n)
+                {
+                    take |= free & -free;
+                    free &= free - 1;
+                }
+                // acquire pairs with the release in releaseItem(), so the
+                // previous owner's writes to the slot are behind us
+                if (word.compare_exchange_weak(old, old | take,
+                                               std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    break;
+                }
+                take = 0;
+            }
+            while (take)
+            {
+                items[count++] = items_start + (w * bits_per_word + std::countr_zero(take)) * ElemSize;
+                take &= take - 1;
+            }
+        }
+        return count;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t AtomicSlab<ElemSize, Lock>::claim(std::span<std::byte*> items)
+    {
+        while (true)
+        {
+            // read before scanning, so grow() can tell whether someone else
+            // added a span in the meantime
+            std::size_t seen_spans = span_count.load(std::memory_order_acquire);
+            Span* start = hint.load(std::memory_order_acquire);
+            if (start)
+            {
+                // from the hint to the end of the list, then from the front
+                // back round to the hint
+                Span* span = start;
+                do
+                {
+                    if (std::size_t count = claimFromSpan(span, items))
+                    {
+                        if (span != start)
+                        {
+                            hint.store(span, std::memory_order_release);
+                        }
+                        return count;
+                    }
+                    span = span->next.load(std::memory_order_acquire);
+                    if (!span)
+                    {
+                        span = first.load(std::memory_order_acquire);
+                    }
+                } while (span != start);
+            }
+            grow(seen_spans);
+        }
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void AtomicSlab<ElemSize, Lock>::grow(std::size_t seen_spans)
+    {
+        std::scoped_lock<Lock> guard(grow_lock);
+        if (span_count.load(std::memory_order_relaxed) != seen_spans)
+        {
+            // another thread grew the slab while we were scanning
+            return;
+        }
+        if (seen_spans >= max_slabs)
+        {
+            throw std::out_of_range(
+                std::format("Cannot allocate more than {} slabs of size {} bytes",
+                            max_slabs, slab_alloc_size));
+        }
+
+        std::byte* base = PageAllocator::map(slab_alloc_size, slab_alloc_size, page_policy);
+        Span* span = new(base) Span{};
+        span->owner = this;
+        span->index = seen_spans;
+        span->elem_size = ElemSize;
+        for (std::size_t bit = items_per_slab; bit < word_count * bits_per_word; ++bit)
+        {
+            span->slots[bit / bits_per_word].fetch_or(uint64_t{1} << (bit % bits_per_word),
+                                                      std::memory_order_relaxed);
+        }
+
+        try
+        {
+            PageMap::instance().set(base, slab_alloc_size, span);
+        }
+        catch (...)
+        {
+            span->~Span();
+            PageAllocator::unmap(base, slab_alloc_size, page_policy);
+            throw;
+        }
+
+        // publish: the release stores make the initialized header visible
+        // to any thread that reaches the span through them
+        if (last)
+        {
+            last->next.store(span, std::memory_order_release);
+        }
+        else
+        {
+            first.store(span, std::memory_order_release);
+        }
+        last = span;
+        span_count.store(seen_spans + 1, std::memory_order_release);
+        hint.store(span, std::memory_order_release);
+        debug_println("New AtomicSlab<{}> span allocated, total spans: {}", ElemSize, seen_spans + 1);
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::pair<typename AtomicSlab<ElemSize, Lock>::Span*, std::size_t>
+    AtomicSlab<ElemSize, Lock>::locateItem(std::byte* item) const
+    {
+        // the span header sits at the span's aligned base; the page map
+        // confirms the base is one of our spans before we read it
+        auto base = reinterpret_cast<std::byte*>(
+            reinterpret_cast<std::uintptr_t>(item) & ~(slab_alloc_size - 1));
+        SpanHeader* header = PageMap::instance().lookup(base);
+        if (reinterpret_cast<std::byte*>(header) != base || header->owner != this)
+        {
+            throw std::invalid_argument("Invalid item pointer; no corresponding slab found");
+        }
+        Span* span = static_cast<Span*>(header);
+
+        auto offset = item - itemsStart(span);
+        if (offset < 0 || offset % ElemSize != 0 || static_cast<std::size_t>(offset) / ElemSize >= items_per_slab)
+        {
+            throw std::invalid_argument("Invalid item pointer; item not found in slab");
+        }
+        return {span, offset / ElemSize};
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void AtomicSlab<ElemSize, Lock>::releaseItem(std::byte* item)
+    {
+        auto [span, item_index] = locateItem(item);
+        uint64_t bit = uint64_t{1} << (item_index % bits_per_word);
+        uint64_t old = span->slots[item_index / bits_per_word].fetch_and(~bit, std::memory_order_release);
+        if (!(old & bit))
+        {
+            throw std::invalid_argument("Item is already free");
+        }
+
+        // steer allocation back to lower spans as they free up, so live
+        // items stay packed toward the front of the list. Acquire: the hint
+        // may be a span another thread just grew, and we read its header.
+        Span* current = hint.load(std::memory_order_acquire);
+        if (current && span->index < current->index)
+        {
+            hint.store(span, std::memory_order_release);
+        }
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void AtomicSlab<ElemSize, Lock>::deallocateItem(std::byte* item)
+    {
+        if (item)
+        {
+            releaseItem(item);
+        }
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void AtomicSlab<ElemSize, Lock>::deallocateBatch(std::span<std::byte* const> items)
+    {
+        // see Slab::deallocateBatch()
+        std::exception_ptr error;
+        for (auto item : items)
+        {
+            try
+            {
+                if (item)
+                {
+                    releaseItem(item);
+                }
+            }
+            catch (const std::invalid_argument&)
+            {
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    SlabUsage AtomicSlab<ElemSize, Lock>::usage()
+    {
+        // bits past items_per_slab are set in every span
+        static constexpr std::size_t padding_bits{word_count * bits_per_word - items_per_slab};
+
+        SlabUsage result;
+        for (Span* span = first.load(std::memory_order_acquire); span;
+             span = span->next.load(std::memory_order_acquire))
+        {
+            std::size_t used = 0;
+            for (auto& word : span->slots)
+            {
+                used += std::popcount(word.load(std::memory_order_relaxed));
+            }
+            result.used_slots += used - padding_bits;
+            ++result.spans;
+        }
+        result.slots = result.spans * items_per_slab;
+        result.reserved_bytes = result.spans * slab_alloc_size;
+        result.peak_reserved_bytes = result.reserved_bytes;
+        return result;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    AtomicSlab<ElemSize, Lock>::AtomicSlab(const PagePolicy& policy)
+        : page_policy(policy)
+    {
+        debug_println("AtomicSlab created with element size: {}, allocation size: {}",
+                      getElemSize(), getAllocSize());
+
+        // the first span is created by the first allocation
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    AtomicSlab<ElemSize, Lock>::~AtomicSlab()
+    {
+        debug_println("AtomicSlab destroyed, freeing {} bytes of memory", getAllocatedMemory());
+        Span* span = first.load(std::memory_order_acquire);
+        while (span)
+        {
+            Span* next = span->next.load(std::memory_order_relaxed);
+            PageMap::instance().clear(reinterpret_cast<std::byte*>(span), slab_alloc_size);
+            span->~Span();
+            PageAllocator::unmap(reinterpret_cast<std::byte*>(span), slab_alloc_size, page_policy);
+            span = next;
+        }
+    }
+
+}; // namespace spallocator
+
+
+#endif // ATOMICSLAB_HPP_
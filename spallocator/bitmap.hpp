@@ -0,0 +1,292 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2025, Michael VanLoon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BITMAP_HPP_
+#define BITMAP_HPP_
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <limits>
+#include <string>
+#include <vector>
+
+
+namespace spallocator
+{
+
+    //
+    // Bitmap is a fixed-size bitset stored as 64-bit words, with the
+    // searches a slab allocator actually needs: find the first clear bit
+    // (a free slot) or the first set bit (an available slab). Each search
+    // looks at one word at a time and uses count-trailing-zeros/ones to
+    // pick the bit, so scanning a 256-slot slab is at most four word
+    // tests instead of 256 std::bitset::test() calls.
+    //
+    // The number of set bits is maintained incrementally, so all(),
+    // none() and freeCount() are O(1).
+    //
+    template<std::size_t Bits>
+    class Bitmap
+    {
+    public: // types
+        static constexpr std::size_t npos{std::numeric_limits<std::size_t>::max()};
+        static constexpr std::size_t bits_per_word{64};
+        static constexpr std::size_t word_count{(Bits + bits_per_word - 1) / bits_per_word};
+
+    public: // methods
+        static constexpr std::size_t size() { return Bits; }
+
+        bool test(std::size_t index) const
+        {
+            return (words[index / bits_per_word] >> (index % bits_per_word)) & 1;
+        }
+
+        void set(std::size_t index)
+        {
+            uint64_t& word = words[index / bits_per_word];
+            uint64_t mask = uint64_t{1} << (index % bits_per_word);
+            set_count += (word & mask) ? 0 : 1;
+            word |= mask;
+        }
+
+        void reset(std::size_t index)
+        {
+            uint64_t& word = words[index / bits_per_word];
+            uint64_t mask = uint64_t{1} << (index % bits_per_word);
+            set_count -= (word & mask) ? 1 : 0;
+            word &= ~mask;
+        }
+
+        void set()
+        {
+            words.fill(~uint64_t{0});
+            if constexpr (Bits % bits_per_word != 0)
+            {
+                // keep the padding bits of the last word clear so word-level
+                // searches never report a bit beyond the end
+                words.back() = (uint64_t{1} << (Bits % bits_per_word)) - 1;
+            }
+            set_count = Bits;
+        }
+
+        void reset()
+        {
+            words.fill(0);
+            set_count = 0;
+        }
+
+        bool all() const { return set_count == Bits; }
+        bool none() const { return set_count == 0; }
+        std::size_t count() const { return set_count; }
+        std::size_t freeCount() const { return Bits - set_count; }
+
+        // Index of the lowest clear bit, or npos if every bit is set
+        std::size_t findFirstClear() const
+        {
+            if (all())
+            {
+                return npos;
+            }
+            for (std::size_t w = 0; w < word_count; ++w)
+            {
+                if (words[w] != ~uint64_t{0})
+                {
+                    std::size_t index = w * bits_per_word + std::countr_one(words[w]);
+                    return index < Bits ? index : npos;
+                }
+            }
+            return npos;
+        }
+
+        // Index of the lowest set bit at or after `from`, or npos if none
+        std::size_t findFirstSet(std::size_t from = 0) const
+        {
+            if (none() || from >= Bits)
+            {
+                return npos;
+            }
+            std::size_t w = from / bits_per_word;
+            uint64_t word = words[w] & (~uint64_t{0} << (from % bits_per_word));
+            while (true)
+            {
+                if (word != 0)
+                {
+                    return w * bits_per_word + std::countr_zero(word);
+                }
+                if (++w >= word_count)
+                {
+                    return npos;
+                }
+                word = words[w];
+            }
+        }
+
+        uint64_t word(std::size_t w) const { return words[w]; }
+
+        // Set up to `max_count` of the lowest clear bits in word `w` in one
+        // go; returns the mask of the bits that were set
+        uint64_t claimWord(std::size_t w, std::size_t max_count)
+        {
+            uint64_t clear = ~words[w];
+            if (w == word_count - 1 && Bits % bits_per_word != 0)
+            {
+                // padding bits beyond the end are never claimable
+                clear &= (uint64_t{1} << (Bits % bits_per_word)) - 1;
+            }
+            uint64_t claimed = clear;
+            if (static_cast<std::size_t>(std::popcount(clear)) > max_count)
+            {
+                claimed = 0;
+                for (std::size_t i = 0; i < max_count; ++i)
+                {
+                    uint64_t lowest = clear & (~clear + 1);
+                    claimed |= lowest;
+                    clear ^= lowest;
+                }
+            }
+            words[w] |= claimed;
+            set_count += std::popcount(claimed);
+            return claimed;
+        }
+
+    private: // data members
+        std::array<uint64_t, word_count> words{};
+        std::size_t set_count{0};
+    };
+
+
+    //
+    // GrowableBitmap is a runtime-sized bitmap for very large maps: it
+    // starts empty and is resized as bits are added or removed, so its
+    // footprint follows the number of bits actually in use rather than a
+    // compile-time maximum. A second summary level (one bit per word, set
+    // when the word has any bit set) lets findFirstSet() skip 4096 bits
+    // per summary word tested.
+    //
+    class GrowableBitmap
+    {
+    public: // types
+        static constexpr std::size_t npos{std::numeric_limits<std::size_t>::max()};
+        static constexpr std::size_t bits_per_word{64};
+
+    public: // methods
+        std::size_t size() const { return bit_count; }
+
+        // Grow or shrink to `bits` bits; new bits are clear
+        void resize(std::size_t bits)
+        {
+            bit_count = bits;
+            words.resize((bits + bits_per_word - 1) / bits_per_word);
+            summary.resize((words.size() + bits_per_word - 1) / bits_per_word);
+            if (bits % bits_per_word != 0)
+            {
+                // drop bits past the new end in the last word
+                std::size_t w = words.size() - 1;
+                words[w] &= (uint64_t{1} << (bits % bits_per_word)) - 1;
+                if (words[w] == 0)
+                {
+                    summary[w / bits_per_word] &= ~(uint64_t{1} << (w % bits_per_word));
+                }
+            }
+            if (words.size() % bits_per_word != 0 && !summary.empty())
+            {
+                // and summary bits for words past the new end
+                summary.back() &= (uint64_t{1} << (words.size() % bits_per_word)) - 1;
+            }
+        }
+
+        bool test(std::size_t index) const
+        {
+            return (words[index / bits_per_word] >> (index % bits_per_word)) & 1;
+        }
+
+        void set(std::size_t index)
+        {
+            std::size_t w = index / bits_per_word;
+            words[w] |= uint64_t{1} << (index % bits_per_word);
+            summary[w / bits_per_word] |= uint64_t{1} << (w % bits_per_word);
+        }
+
+        void reset(std::size_t index)
+        {
+            std::size_t w = index / bits_per_word;
+            words[w] &= ~(uint64_t{1} << (index % bits_per_word));
+            if (words[w] == 0)
+            {
+                summary[w / bits_per_word] &= ~(uint64_t{1} << (w % bits_per_word));
+            }
+        }
+
+        // Index of the lowest set bit, or npos if none
+        std::size_t findFirstSet() const
+        {
+            for (std::size_t s = 0; s < summary.size(); ++s)
+            {
+                if (summary[s] != 0)
+                {
+                    std::size_t w = s * bits_per_word + std::countr_zero(summary[s]);
+                    return w * bits_per_word + std::countr_zero(words[w]);
+                }
+            }
+            return npos;
+        }
+
+    private: // data members
+        std::vector<uint64_t> words;
+        std::vector<uint64_t> summary;
+        std::size_t bit_count{0};
+    };
+
+
+    // Helper for debug output
+    template<std::size_t N>
+    std::string printHex(const Bitmap<N>& bits)
+    {
+        std::string out;
+        for (std::size_t w = Bitmap<N>::word_count; w-- > 0; )
+        {
+            if (w < Bitmap<N>::word_count - 1)
+            {
+                out += " ";
+            }
+            out += std::format("{:016X}", bits.word(w));
+        }
+        return out;
+    }
+
+}; // namespace spallocator
+
+
+#endif // BITMAP_HPP_
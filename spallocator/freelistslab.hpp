@@ -0,0 +1,553 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2025, Michael VanLoon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FREELISTSLAB_HPP_
+#define FREELISTSLAB_HPP_
+
+#include <cstddef>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "helper.hpp"
+#include "spinlock.hpp"
+#include "pagemap.hpp"
+#include "slab.hpp"
+
+
+namespace spallocator
+{
+
+    //
+    // FreeListSlab is an alternate slab engine with the same interface as
+    // Slab<ElemSize>, but it tracks free slots with intrusive singly-linked
+    // lists instead of bitsets:
+    //
+    // - each slab threads its freed slots into a list that lives in the
+    //   slots themselves (the first 8 bytes of a free slot point at the
+    //   next free slot), so the tracking costs no memory at all
+    // - never-used slots are handed out from a per-slab bump pointer, so a
+    //   new slab doesn't have to be touched end to end to build its list
+    // - slabs with at least one free slot are linked into a list of
+    //   non-full slabs; allocation always takes from its head
+    //
+    // Like Slab, each slab is a naturally aligned span with its bookkeeping
+    // in a header at the start, so deallocation finds it by masking the
+    // pointer. Allocation is a pop and deallocation is a push, independent
+    // of how many slabs the size class has grown to. The trade-off is that a
+    // double free can only be detected by walking the slab's free list,
+    // which is done in debug builds only.
+    //
+    template<const std::size_t ElemSize, Lockable Lock = SpinLock>
+    class FreeListSlab: public AbstractSlab
+    {
+    public: // methods
+        std::byte* allocateItem(std::size_t size);
+        void deallocateItem(std::byte* item);
+        std::byte* allocateZeroedItem(std::size_t size);
+
+        std::size_t allocateBatch(std::size_t size, std::span<std::byte*> items);
+        std::size_t allocateTaggedBatch(std::size_t size, std::span<std::byte*> items);
+        void deallocateBatch(std::span<std::byte* const> items);
+
+        // Unmap slabs that have been empty for the decay window; each slab
+        // is its own mapping, so it can go back to the OS entirely
+        std::size_t trim(const TrimPolicy& policy);
+
+        LockStatsSnapshot lockStats() const
+        {
+            if constexpr (requires { slab_lock.stats(); })
+            {
+                return slab_lock.stats();
+            }
+            return {};
+        }
+
+        SlabUsage usage();
+
+        constexpr std::size_t getElemSize() const { return ElemSize; }
+        constexpr std::size_t getAllocSize() const { return slab_alloc_size; }
+        static constexpr std::size_t getItemsPerSlab() { return items_per_slab; }
+        std::size_t getAllocatedMemory() const { return slabs.size() * slab_alloc_size; }
+
+        // see Slab::getWasteBytes()
+        static constexpr std::size_t getWasteBytes() { return slab_alloc_size - items_per_slab * ElemSize; }
+        static constexpr double getOccupancy() { return double(items_per_slab * ElemSize) / slab_alloc_size; }
+
+        explicit FreeListSlab(const PagePolicy& policy = {});
+        virtual ~FreeListSlab();
+
+    private: // types
+        struct FreeItem
+        {
+            FreeItem* next;
+        };
+
+        // span header; the items follow it in the same span
+        struct SlabInfo: SpanHeader
+        {
+            FreeItem* free_list{nullptr};   // recycled slots
+            std::size_t unused_index{0};    // first never-allocated slot
+            std::size_t used_count{0};
+            SlabInfo* next_available{nullptr};
+            bool is_available{false};       // linked into available list
+            std::chrono::steady_clock::time_point empty_since{};
+        };
+
+    private: // methods
+        FreeListSlab(const FreeListSlab&) = delete;
+        FreeListSlab& operator=(const FreeListSlab&) = delete;
+        FreeListSlab(FreeListSlab&&) = delete;
+        FreeListSlab& operator=(FreeListSlab&&) = delete;
+
+        void allocateNewSlab();
+        SlabInfo* findSlabForItem(std::byte* item);
+        static std::byte* itemsStart(SlabInfo* slab)
+        {
+            return reinterpret_cast<std::byte*>(slab) + data_offset;
+        }
+
+        // see Slab::locateItem(); the bump pointer isn't checked here since
+        // it can only be read under slab_lock
+        SlabInfo* locateItem(std::byte* item);
+
+        // must be called with slab_lock held
+        std::byte* allocateItemLocked(bool* fresh = nullptr);
+        std::size_t allocateBatchImpl(std::size_t size, std::span<std::byte*> items, bool tag_fresh);
+        void deallocateItemLocked(std::byte* item);
+        void drainRemoteFrees();
+
+    private: // data members
+        static constexpr std::size_t slab_alloc_size{selectBufferSize<ElemSize>()};
+        static constexpr std::size_t data_offset{spanDataOffset(sizeof(SlabInfo), ElemSize)};
+        static constexpr std::size_t items_per_slab{(slab_alloc_size - data_offset) / ElemSize};
+        static_assert(data_offset <= spanDataOffset(spanHeaderBound(slab_alloc_size / ElemSize), ElemSize),
+            "Span header exceeds the bound selectBufferSize() sized the span for");
+        static constexpr std::size_t max_slabs{4_GB / slab_alloc_size};
+
+        static_assert(ElemSize >= sizeof(FreeItem), "Element size must hold a free list link");
+        // A pushed item's remote link overwrites the word the free list
+        // links through, so pushing a slot that is already free would
+        // corrupt the list before the drain could catch the double free.
+        // Debug builds, which check for that, wait for the lock instead.
+        static constexpr bool may_defer_frees{!DEBUG_BUILD};
+
+        std::vector<SlabInfo*> slabs;
+        SlabInfo* available_slabs{nullptr};
+        // high-water mark of getAllocatedMemory()
+        std::size_t peak_reserved{0};
+        PagePolicy page_policy;
+
+        Lock slab_lock;
+        // see Slab::remote_frees
+        RemoteFreeList remote_frees;
+    };
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::byte* FreeListSlab<ElemSize, Lock>::allocateItem(std::size_t size)
+    {
+        runtime_assert(size <= ElemSize, [&] {
+            return std::format("Requested size {} exceeds slab element size {}", size, ElemSize);
+        });
+
+        std::scoped_lock<Lock> guard(slab_lock);
+        drainRemoteFrees();
+        return allocateItemLocked();
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::byte* FreeListSlab<ElemSize, Lock>::allocateZeroedItem(std::size_t size)
+    {
+        runtime_assert(size <= ElemSize, [&] {
+            return std::format("Requested size {} exceeds slab element size {}", size, ElemSize);
+        });
+
+        bool fresh = false;
+        std::byte* item = nullptr;
+        {
+            std::scoped_lock<Lock> guard(slab_lock);
+            drainRemoteFrees();
+            item = allocateItemLocked(&fresh);
+        }
+        if (!fresh)
+        {
+            std::memset(item, 0, size);
+        }
+        return item;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t FreeListSlab<ElemSize, Lock>::allocateBatch(std::size_t size, std::span<std::byte*> items)
+    {
+        return allocateBatchImpl(size, items, false);
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t FreeListSlab<ElemSize, Lock>::allocateTaggedBatch(std::size_t size, std::span<std::byte*> items)
+    {
+        return allocateBatchImpl(size, items, true);
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t FreeListSlab<ElemSize, Lock>::allocateBatchImpl(std::size_t size, std::span<std::byte*> items, bool tag_fresh)
+    {
+        runtime_assert(size <= ElemSize, [&] {
+            return std::format("Requested size {} exceeds slab element size {}", size, ElemSize);
+        });
+
+        std::scoped_lock<Lock> guard(slab_lock);
+        drainRemoteFrees();
+        std::size_t count = 0;
+        try
+        {
+            for (; count < items.size(); ++count)
+            {
+                bool fresh = false;
+                items[count] = allocateItemLocked(tag_fresh ? &fresh : nullptr);
+                items[count] = tagFresh(items[count], fresh);
+            }
+        }
+        catch (const std::out_of_range&)
+        {
+            // exhausted part way through; hand back what we did get
+            if (count == 0)
+            {
+                throw;
+            }
+        }
+        return count;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::byte* FreeListSlab<ElemSize, Lock>::allocateItemLocked(bool* fresh /* = nullptr */)
+    {
+        if (!available_slabs)
+        {
+            allocateNewSlab();
+            debug_println("New free-list slab<{}> allocated, total slabs: {}", ElemSize, slabs.size());
+        }
+
+        SlabInfo* slab = available_slabs;
+        std::byte* item = nullptr;
+        if (slab->free_list)
+        {
+            item = reinterpret_cast<std::byte*>(slab->free_list);
+            slab->free_list = slab->free_list->next;
+            if (fresh)
+            {
+                *fresh = false;
+            }
+        }
+        else
+        {
+            // slots past the bump pointer have never been written
+            item = itemsStart(slab) + slab->unused_index * ElemSize;
+            ++slab->unused_index;
+            if (fresh)
+            {
+                *fresh = PageAllocator::maps_zeroed;
+            }
+        }
+
+        if (++slab->used_count == items_per_slab)
+        {
+            // this slab is now full; only the head is ever allocated from,
+            // so unlinking it is a pop
+            available_slabs = slab->next_available;
+            slab->next_available = nullptr;
+            slab->is_available = false;
+        }
+        return item;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    typename FreeListSlab<ElemSize, Lock>::SlabInfo* FreeListSlab<ElemSize, Lock>::findSlabForItem(std::byte* item)
+    {
+        // see Slab::findSpanForItem()
+        auto base = reinterpret_cast<std::byte*>(
+            reinterpret_cast<std::uintptr_t>(item) & ~(slab_alloc_size - 1));
+        SpanHeader* header = PageMap::instance().lookup(base);
+        if (reinterpret_cast<std::byte*>(header) != base || header->owner != this)
+        {
+            return nullptr;
+        }
+        return static_cast<SlabInfo*>(header);
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void FreeListSlab<ElemSize, Lock>::deallocateItem(std::byte* item)
+    {
+        remote_frees.deallocate(slab_lock, item,
+                                [this](std::byte* item) { locateItem(item); },
+                                [this](std::byte* item) { deallocateItemLocked(item); },
+                                may_defer_frees);
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void FreeListSlab<ElemSize, Lock>::deallocateBatch(std::span<std::byte* const> items)
+    {
+        remote_frees.deallocateBatch(slab_lock, items,
+                                     [this](std::byte* item) { locateItem(item); },
+                                     [this](std::byte* item) { deallocateItemLocked(item); },
+                                     may_defer_frees);
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    typename FreeListSlab<ElemSize, Lock>::SlabInfo* FreeListSlab<ElemSize, Lock>::locateItem(std::byte* item)
+    {
+        SlabInfo* slab = findSlabForItem(item);
+        if (!slab)
+        {
+            throw std::invalid_argument("Invalid item pointer; no corresponding slab found");
+        }
+
+        auto offset = item - itemsStart(slab);
+        if (offset < 0 || offset % ElemSize != 0 || static_cast<std::size_t>(offset) / ElemSize >= items_per_slab)
+        {
+            throw std::invalid_argument("Invalid item pointer; not an allocated slot");
+        }
+        return slab;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void FreeListSlab<ElemSize, Lock>::drainRemoteFrees()
+    {
+        remote_frees.drain([this](std::byte* item) { deallocateItemLocked(item); });
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void FreeListSlab<ElemSize, Lock>::deallocateItemLocked(std::byte* item)
+    {
+        SlabInfo* slab = locateItem(item);
+        if (static_cast<std::size_t>(item - itemsStart(slab)) / ElemSize >= slab->unused_index)
+        {
+            throw std::invalid_argument("Invalid item pointer; not an allocated slot");
+        }
+
+        if constexpr (DEBUG_BUILD)
+        {
+            for (FreeItem* free_item = slab->free_list; free_item; free_item = free_item->next)
+            {
+                if (reinterpret_cast<std::byte*>(free_item) == item)
+                {
+                    throw std::invalid_argument("Item is already free");
+                }
+            }
+        }
+
+        auto free_item = reinterpret_cast<FreeItem*>(item);
+        free_item->next = slab->free_list;
+        slab->free_list = free_item;
+        if (--slab->used_count == 0)
+        {
+            slab->empty_since = std::chrono::steady_clock::now();
+        }
+
+        if (!slab->is_available)
+        {
+            // full slab regained a slot
+            slab->next_available = available_slabs;
+            available_slabs = slab;
+            slab->is_available = true;
+        }
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t FreeListSlab<ElemSize, Lock>::trim(const TrimPolicy& policy)
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::size_t hot = 0;
+
+        std::scoped_lock<Lock> guard(slab_lock);
+        drainRemoteFrees();
+        std::vector<SlabInfo*> victims;
+        std::size_t kept = 0;
+        for (auto slab : slabs)
+        {
+            bool release = false;
+            if (slab->used_count == 0)
+            {
+                if (hot < policy.hot_spans)
+                {
+                    ++hot;
+                }
+                else
+                {
+                    release = now - slab->empty_since >= policy.decay;
+                }
+            }
+
+            if (release)
+            {
+                // an empty slab is always on the available list; clearing
+                // the flag marks it for unlinking below
+                slab->is_available = false;
+                victims.push_back(slab);
+            }
+            else
+            {
+                slab->index = kept;
+                slabs[kept++] = slab;
+            }
+        }
+        slabs.resize(kept);
+
+        for (SlabInfo** link = &available_slabs; *link; )
+        {
+            if ((*link)->is_available)
+            {
+                link = &(*link)->next_available;
+            }
+            else
+            {
+                *link = (*link)->next_available;
+            }
+        }
+
+        for (auto slab : victims)
+        {
+            PageMap::instance().clear(reinterpret_cast<std::byte*>(slab), slab_alloc_size);
+            slab->~SlabInfo();
+            PageAllocator::unmap(reinterpret_cast<std::byte*>(slab), slab_alloc_size, page_policy);
+        }
+        debug_println("Trimmed {} slabs from free-list slab<{}>", victims.size(), ElemSize);
+        return victims.size() * slab_alloc_size;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    SlabUsage FreeListSlab<ElemSize, Lock>::usage()
+    {
+        std::scoped_lock<Lock> guard(slab_lock);
+        drainRemoteFrees();
+        SlabUsage result;
+        result.spans = slabs.size();
+        result.slots = slabs.size() * items_per_slab;
+        for (auto slab : slabs)
+        {
+            result.used_slots += slab->used_count;
+        }
+        result.reserved_bytes = getAllocatedMemory();
+        result.peak_reserved_bytes = peak_reserved;
+        return result;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    FreeListSlab<ElemSize, Lock>::FreeListSlab(const PagePolicy& policy)
+        : page_policy(policy)
+    {
+        debug_println("FreeListSlab created with element size: {}, allocation size: {}",
+                      getElemSize(), getAllocSize());
+
+        // the first slab is created by the first allocation
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    FreeListSlab<ElemSize, Lock>::~FreeListSlab()
+    {
+        debug_println("FreeListSlab destroyed, freeing {} bytes of memory", getAllocatedMemory());
+        for (auto slab : slabs)
+        {
+            PageMap::instance().clear(reinterpret_cast<std::byte*>(slab), slab_alloc_size);
+            slab->~SlabInfo();
+            PageAllocator::unmap(reinterpret_cast<std::byte*>(slab), slab_alloc_size, page_policy);
+        }
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void FreeListSlab<ElemSize, Lock>::allocateNewSlab()
+    {
+        if (slabs.size() >= max_slabs)
+        {
+            throw std::out_of_range(
+                std::format("Cannot allocate more than {} slabs of size {} bytes",
+                            max_slabs, slab_alloc_size));
+        }
+
+        static_assert(ElemSize >= 16,
+            "Element size must be at least 16 bytes");
+        static_assert(ElemSize % 16 == 0,
+            "Element size must be a multiple of 16 bytes");
+
+        slabs.reserve(slabs.size() + 1);
+        // each slab is its own mapping; with HugePages::hugetlb that rounds
+        // every slab up to a huge page, so prefer the bitmap engine there
+        std::byte* base = PageAllocator::map(slab_alloc_size, slab_alloc_size, page_policy);
+        SlabInfo* slab = new(base) SlabInfo{};
+        slab->owner = this;
+        slab->index = slabs.size();
+        slab->elem_size = ElemSize;
+
+        try
+        {
+            PageMap::instance().set(base, slab_alloc_size, slab);
+        }
+        catch (...)
+        {
+            PageAllocator::unmap(base, slab_alloc_size, page_policy);
+            throw;
+        }
+
+        slab->next_available = available_slabs;
+        slab->is_available = true;
+        available_slabs = slab;
+
+        slabs.push_back(slab);
+        peak_reserved = std::max(peak_reserved, getAllocatedMemory());
+    }
+
+}; // namespace spallocator
+
+
+#endif // FREELISTSLAB_HPP_
@@ -33,12 +33,14 @@
 #ifndef HELPER_HPP_
 #define HELPER_HPP_
 
+#include <concepts>
 #include <cstddef>
 #include <cstdlib>
 #include <iostream>
 #include <format>
 #include <print>
 #include <source_location>
+#include <string>
 
 
 #ifndef NDEBUG
@@ -161,6 +163,23 @@ namespace spallocator
         runtime_assert(condition, message.c_str(), loc);
     }
 
+    // For messages that cost something to build (std::format allocates):
+    // `make_message` only runs if the assertion fails, so passing checks,
+    // and release builds, don't pay for the message.
+    template<std::invocable MessageFn>
+    inline void runtime_assert(bool condition,
+                               MessageFn&& make_message,
+                               const std::source_location& loc = std::source_location::current())
+    {
+        if constexpr (DEBUG_BUILD)
+        {
+            if (!condition)
+            {
+                runtime_assert(false, std::string(make_message()), loc);
+            }
+        }
+    }
+
 } // namespace spallocator
 
 
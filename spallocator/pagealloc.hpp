@@ -0,0 +1,309 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2025, Michael VanLoon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PAGEALLOC_HPP_
+#define PAGEALLOC_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/mman.h>
+    #define SPALLOCATOR_HAS_MMAP 1
+#endif
+
+#include "helper.hpp"
+
+
+namespace spallocator
+{
+
+    // Huge page mode for slab memory
+    enum class HugePages
+    {
+        off,            // normal pages
+        transparent,    // madvise(MADV_HUGEPAGE): let the kernel promote to THP
+        hugetlb         // MAP_HUGETLB from the reserved pool, falling back to
+                        // transparent if none are available
+    };
+
+
+    // Per-pool policy for how slab memory is obtained from the OS
+    struct PagePolicy
+    {
+        HugePages huge_pages{HugePages::off};
+        bool prefault{false};   // populate page tables up front (MAP_POPULATE)
+    };
+
+
+    //
+    // PageAllocator is the page-level backing layer under the slabs: it
+    // reserves aligned virtual regions directly with mmap, applies the
+    // pool's huge page and prefault policy, and unmaps them again. Slabs
+    // carve their spans out of these regions.
+    //
+    // Alignment beyond the page size is obtained by over-reserving and
+    // trimming the ends. With HugePages::hugetlb every region is rounded up
+    // to whole huge pages (on both map and unmap, so the sizes always
+    // agree, whichever path the mapping ended up taking).
+    //
+    // On platforms without mmap this falls back to std::aligned_alloc and
+    // the policy is ignored.
+    //
+    class PageAllocator
+    {
+    public: // types
+        static constexpr std::size_t huge_page_size{2_MB};
+
+        // Whether freshly mapped memory is guaranteed to read as zero
+    #ifdef SPALLOCATOR_HAS_MMAP
+        static constexpr bool maps_zeroed{true};
+    #else
+        static constexpr bool maps_zeroed{false};
+    #endif
+
+    public: // methods
+        // Map `size` bytes aligned to `alignment` (a power of two); throws
+        // std::bad_alloc on failure
+        static std::byte* map(std::size_t size, std::size_t alignment, const PagePolicy& policy);
+
+        // Unmap a region from map(), with the same size and policy
+        static void unmap(std::byte* ptr, std::size_t size, const PagePolicy& policy);
+
+        // Resize a region from map() to `new_size`, keeping it aligned to
+        // `alignment`. Pages are moved rather than copied where the OS
+        // allows it (mremap on Linux): first by growing in place, then by
+        // moving the page tables to a fresh aligned reservation. Elsewhere,
+        // and for hugetlb, it maps, copies and unmaps. Throws std::bad_alloc.
+        static std::byte* remap(std::byte* ptr, std::size_t old_size, std::size_t new_size,
+                                std::size_t alignment, const PagePolicy& policy);
+
+        // Give the physical pages of part of a mapping back to the OS while
+        // keeping the address range; the next touch faults in zero pages.
+        // `ptr` and `size` must be page aligned. Returns the bytes released,
+        // which is 0 where that isn't possible (hugetlb pages can't be
+        // partially released, and without mmap there is nothing to advise).
+        static std::size_t decommit(std::byte* ptr, std::size_t size, const PagePolicy& policy);
+
+        // Size actually reserved for a request of `size` bytes
+        static constexpr std::size_t mappedSize(std::size_t size, const PagePolicy& policy)
+        {
+            std::size_t granularity = policy.huge_pages == HugePages::hugetlb ? huge_page_size : 4_KB;
+            return (size + granularity - 1) & ~(granularity - 1);
+        }
+
+    private: // methods
+        PageAllocator() = delete;
+
+    #ifdef SPALLOCATOR_HAS_MMAP
+        static std::byte* mapAligned(std::size_t size, std::size_t alignment, int extra_flags);
+    #endif
+    };
+
+
+#ifdef SPALLOCATOR_HAS_MMAP
+
+    inline std::byte* PageAllocator::mapAligned(std::size_t size, std::size_t alignment, int extra_flags)
+    {
+        // mmap only guarantees page alignment; reserve enough to slide up
+        // to the requested alignment, then give back the ends
+        std::size_t reserve = size + (alignment > 4_KB ? alignment : 0);
+        void* raw = ::mmap(nullptr, reserve, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+        if (raw == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        auto base = reinterpret_cast<std::uintptr_t>(raw);
+        auto aligned = (base + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+        if (aligned > base)
+        {
+            ::munmap(raw, aligned - base);
+        }
+        std::size_t tail = base + reserve - (aligned + size);
+        if (tail > 0)
+        {
+            ::munmap(reinterpret_cast<void*>(aligned + size), tail);
+        }
+        return reinterpret_cast<std::byte*>(aligned);
+    }
+
+
+    inline std::byte* PageAllocator::map(std::size_t size, std::size_t alignment, const PagePolicy& policy)
+    {
+        size = mappedSize(size, policy);
+
+        int flags = 0;
+    #ifdef MAP_POPULATE
+        if (policy.prefault)
+        {
+            flags |= MAP_POPULATE;
+        }
+    #endif
+
+        std::byte* region = nullptr;
+    #ifdef MAP_HUGETLB
+        if (policy.huge_pages == HugePages::hugetlb)
+        {
+            // hugetlb mappings are huge-page aligned, so only alignments
+            // beyond that need trimming (which then falls on huge pages)
+            region = mapAligned(size, alignment > huge_page_size ? alignment : huge_page_size,
+                                flags | MAP_HUGETLB);
+            if (region)
+            {
+                return region;
+            }
+            debug_println("No huge pages reserved for {} bytes; falling back to THP", size);
+        }
+    #endif
+
+        region = mapAligned(size, alignment, flags);
+        if (!region)
+        {
+            throw std::bad_alloc();
+        }
+
+    #ifdef MADV_HUGEPAGE
+        if (policy.huge_pages != HugePages::off)
+        {
+            // advisory only; ignore failure (e.g. THP disabled system-wide)
+            ::madvise(region, size, MADV_HUGEPAGE);
+        }
+    #endif
+        return region;
+    }
+
+
+    inline void PageAllocator::unmap(std::byte* ptr, std::size_t size, const PagePolicy& policy)
+    {
+        if (ptr)
+        {
+            ::munmap(ptr, mappedSize(size, policy));
+        }
+    }
+
+
+    inline std::byte* PageAllocator::remap(std::byte* ptr, std::size_t old_size, std::size_t new_size,
+                                           std::size_t alignment, const PagePolicy& policy)
+    {
+        old_size = mappedSize(old_size, policy);
+        new_size = mappedSize(new_size, policy);
+        if (new_size == old_size)
+        {
+            return ptr;
+        }
+
+    #if defined(MREMAP_MAYMOVE) && defined(MREMAP_FIXED)
+        if (policy.huge_pages != HugePages::hugetlb)
+        {
+            // shrinking, or growing into free address space right after it
+            if (::mremap(ptr, old_size, new_size, 0) != MAP_FAILED)
+            {
+                return ptr;
+            }
+
+            // reserve an aligned target and move the pages onto it; the
+            // target's own (untouched) pages are replaced
+            std::byte* target = map(new_size, alignment, policy);
+            void* moved = ::mremap(ptr, old_size, new_size, MREMAP_MAYMOVE | MREMAP_FIXED, target);
+            if (moved != MAP_FAILED)
+            {
+                return target;
+            }
+            unmap(target, new_size, policy);
+        }
+    #endif
+
+        std::byte* target = map(new_size, alignment, policy);
+        std::memcpy(target, ptr, old_size < new_size ? old_size : new_size);
+        unmap(ptr, old_size, policy);
+        return target;
+    }
+
+
+    inline std::size_t PageAllocator::decommit(std::byte* ptr, std::size_t size, const PagePolicy& policy)
+    {
+        if (size == 0 || policy.huge_pages == HugePages::hugetlb)
+        {
+            return 0;
+        }
+        return ::madvise(ptr, size, MADV_DONTNEED) == 0 ? size : 0;
+    }
+
+#else // !SPALLOCATOR_HAS_MMAP
+
+    inline std::byte* PageAllocator::map(std::size_t size, std::size_t alignment, const PagePolicy& policy)
+    {
+        // aligned_alloc wants a multiple of the alignment, and free() needs
+        // neither size nor alignment
+        size = (mappedSize(size, policy) + alignment - 1) & ~(alignment - 1);
+        auto region = static_cast<std::byte*>(std::aligned_alloc(alignment, size));
+        if (!region)
+        {
+            throw std::bad_alloc();
+        }
+        return region;
+    }
+
+
+    inline void PageAllocator::unmap(std::byte* ptr, std::size_t /* size */, const PagePolicy& /* policy */)
+    {
+        std::free(ptr);
+    }
+
+
+    inline std::byte* PageAllocator::remap(std::byte* ptr, std::size_t old_size, std::size_t new_size,
+                                           std::size_t alignment, const PagePolicy& policy)
+    {
+        std::byte* target = map(new_size, alignment, policy);
+        std::memcpy(target, ptr, old_size < new_size ? old_size : new_size);
+        unmap(ptr, old_size, policy);
+        return target;
+    }
+
+
+    inline std::size_t PageAllocator::decommit(std::byte* /* ptr */, std::size_t /* size */,
+                                               const PagePolicy& /* policy */)
+    {
+        return 0;
+    }
+
+#endif // SPALLOCATOR_HAS_MMAP
+
+}; // namespace spallocator
+
+
+#endif // PAGEALLOC_HPP_
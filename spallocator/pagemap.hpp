@@ -0,0 +1,247 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2025, Michael VanLoon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PAGEMAP_HPP_
+#define PAGEMAP_HPP_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+
+#include "helper.hpp"
+#include "spinlock.hpp"
+
+
+namespace spallocator
+{
+
+    class AbstractSlab;
+
+
+    // Slab memory is carved into spans: power-of-two sized blocks aligned
+    // to their own size, so the span that owns any item is found by
+    // masking off the low bits of the item's address. This is the smallest
+    // span, and the granularity at which the PageMap records spans.
+    inline constexpr std::size_t min_span_size{64_KB};
+
+
+    //
+    // SpanHeader sits at the very start of every span. Each slab engine
+    // derives its own span type from it to add per-span slot tracking.
+    //
+    struct SpanHeader
+    {
+        AbstractSlab* owner{nullptr};
+        std::size_t index{0};       // position in the owner's span list
+        std::size_t elem_size{0};   // lets Pool find the size class from an address
+    };
+
+
+    // Every slot is aligned to the largest power of two dividing its size,
+    // up to a page: spans are aligned to at least min_span_size, and items
+    // start at a multiple of that alignment (see spanDataOffset())
+    inline constexpr std::size_t max_slot_alignment{4_KB};
+
+    constexpr std::size_t slotAlignment(std::size_t elem_size)
+    {
+        return std::min(elem_size & (~elem_size + 1), max_slot_alignment);
+    }
+
+    // Items start at the first boundary after an engine's header that is a
+    // multiple of both 16 bytes and the slot alignment
+    constexpr std::size_t spanDataOffset(std::size_t header_size, std::size_t elem_size = 16)
+    {
+        std::size_t alignment = std::max<std::size_t>(16, slotAlignment(elem_size));
+        return (header_size + alignment - 1) & ~(alignment - 1);
+    }
+
+
+    //
+    // PageMap is a process-wide radix tree from address (at min_span_size
+    // granularity) to the SpanHeader of the span covering it. Slabs
+    // register every span they create and clear it again when the span is
+    // released.
+    //
+    // Its job is to make pointer-to-span lookup both O(1) and safe: a slab
+    // masks an item pointer down to its span base, and the page map
+    // confirms that base really is a live span before the header is read.
+    // An arbitrary pointer (not from any slab) simply finds no entry, which
+    // is also how Pool tells large (SlabProxy) blocks from slab items
+    // without keeping a size header in front of every allocation.
+    //
+    // Three levels cover a 48-bit address space. Interior nodes are
+    // created on demand and never freed; lookups are lock-free (acquire
+    // loads), while creating a node takes a lock.
+    //
+    class PageMap
+    {
+    public: // methods
+        static PageMap& instance()
+        {
+            // intentionally never destroyed: slabs owned by other static
+            // objects may still unregister spans during static destruction
+            static PageMap* map = new PageMap;
+            return *map;
+        }
+
+        void set(const std::byte* base, std::size_t size, SpanHeader* span);
+        void clear(const std::byte* base, std::size_t size);
+        SpanHeader* lookup(const void* ptr) const;
+
+    private: // types
+        static constexpr std::size_t address_bits{48};
+        static constexpr std::size_t page_shift{std::countr_zero(min_span_size)};
+        static constexpr std::size_t key_bits{address_bits - page_shift};
+        static constexpr std::size_t leaf_bits{key_bits / 3};
+        static constexpr std::size_t mid_bits{key_bits / 3};
+        static constexpr std::size_t root_bits{key_bits - leaf_bits - mid_bits};
+
+        struct Leaf
+        {
+            std::array<std::atomic<SpanHeader*>, std::size_t{1} << leaf_bits> spans{};
+        };
+
+        struct Mid
+        {
+            std::array<std::atomic<Leaf*>, std::size_t{1} << mid_bits> leaves{};
+        };
+
+    private: // methods
+        PageMap() = default;
+        ~PageMap() = default;
+        PageMap(const PageMap&) = delete;
+        PageMap& operator=(const PageMap&) = delete;
+        PageMap(PageMap&&) = delete;
+        PageMap& operator=(PageMap&&) = delete;
+
+        static std::uintptr_t keyFor(const void* ptr)
+        {
+            return reinterpret_cast<std::uintptr_t>(ptr) >> page_shift;
+        }
+
+        std::atomic<SpanHeader*>* entryFor(std::uintptr_t key, bool create);
+
+    private: // data members
+        std::array<std::atomic<Mid*>, std::size_t{1} << root_bits> root{};
+        SpinLock grow_lock;
+    };
+
+
+    inline std::atomic<SpanHeader*>* PageMap::entryFor(std::uintptr_t key, bool create)
+    {
+        if (key >> key_bits)
+        {
+            if (create)
+            {
+                throw std::out_of_range("Span address is beyond the page map's 48-bit range");
+            }
+            return nullptr;
+        }
+
+        auto& mid_slot = root[key >> (mid_bits + leaf_bits)];
+        Mid* mid = mid_slot.load(std::memory_order_acquire);
+        if (!mid)
+        {
+            if (!create)
+            {
+                return nullptr;
+            }
+            std::scoped_lock<SpinLock> guard(grow_lock);
+            mid = mid_slot.load(std::memory_order_relaxed);
+            if (!mid)
+            {
+                mid = new Mid;
+                mid_slot.store(mid, std::memory_order_release);
+            }
+        }
+
+        auto& leaf_slot = mid->leaves[(key >> leaf_bits) & ((std::size_t{1} << mid_bits) - 1)];
+        Leaf* leaf = leaf_slot.load(std::memory_order_acquire);
+        if (!leaf)
+        {
+            if (!create)
+            {
+                return nullptr;
+            }
+            std::scoped_lock<SpinLock> guard(grow_lock);
+            leaf = leaf_slot.load(std::memory_order_relaxed);
+            if (!leaf)
+            {
+                leaf = new Leaf;
+                leaf_slot.store(leaf, std::memory_order_release);
+            }
+        }
+
+        return &leaf->spans[key & ((std::size_t{1} << leaf_bits) - 1)];
+    }
+
+
+    inline void PageMap::set(const std::byte* base, std::size_t size, SpanHeader* span)
+    {
+        runtime_assert(size % min_span_size == 0 && keyFor(base) << page_shift == reinterpret_cast<std::uintptr_t>(base),
+            "Spans must be aligned multiples of min_span_size");
+
+        // release: the span header must be visible to anyone who finds it
+        for (std::size_t offset = 0; offset < size; offset += min_span_size)
+        {
+            entryFor(keyFor(base + offset), true)->store(span, std::memory_order_release);
+        }
+    }
+
+
+    inline void PageMap::clear(const std::byte* base, std::size_t size)
+    {
+        for (std::size_t offset = 0; offset < size; offset += min_span_size)
+        {
+            if (auto entry = entryFor(keyFor(base + offset), false))
+            {
+                entry->store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    }
+
+
+    inline SpanHeader* PageMap::lookup(const void* ptr) const
+    {
+        auto entry = const_cast<PageMap*>(this)->entryFor(keyFor(ptr), false);
+        return entry ? entry->load(std::memory_order_acquire) : nullptr;
+    }
+
+}; // namespace spallocator
+
+
+#endif // PAGEMAP_HPP_
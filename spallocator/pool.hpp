@@ -33,7 +33,26 @@
 #ifndef POOL_HPP_
 #define POOL_HPP_
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
 #include "slab.hpp"
+#include "freelistslab.hpp"
+#include "atomicslab.hpp"
+#include "threadcache.hpp"
 
 
 namespace spallocator
@@ -46,32 +65,373 @@ namespace spallocator
     };
 
 
-    class Pool
+    // Where a pool caches free slots in front of its slabs
+    enum class CacheMode
+    {
+        none,           // every allocation and free goes to the slab
+        per_thread,     // a ThreadCache per thread that uses the pool
+        per_cpu         // a PerCpuCache shard per CPU; falls back to none
+                        // where the current CPU can't be queried
+    };
+
+
+    //
+    // SizeClassStats is one entry of a BasicPool::stats() snapshot, for a
+    // size class or for the pool's large blocks. The slab figures are
+    // always filled in; the operation counts need Config::collect_stats.
+    //
+    struct SizeClassStats
     {
+        std::size_t elem_size{0};       // slot size; 0 for large blocks
+        std::size_t live_items{0};      // allocated and not yet freed
+        std::size_t cached_items{0};    // free, but held by a pool cache
+        std::size_t free_slots{0};      // free in the slab's spans
+        std::size_t span_count{0};      // spans, or large blocks held
+        std::size_t reserved_bytes{0};  // memory mapped for them
+        std::size_t peak_reserved_bytes{0};
+        uint64_t requested_bytes{0};    // total size passed to allocate()
+        uint64_t allocations{0};
+        uint64_t frees{0};
+    };
+
+
+    //
+    // SizeClasses is a compile-time size-class table for BasicPool: the
+    // element size of each small slab, in increasing order. Requests larger
+    // than the last class go to SlabProxy.
+    //
+    // Every class must be a multiple of 16 bytes, which is what lets every
+    // slot satisfy the pool's 16-byte alignment guarantee. Larger
+    // alignments are served by classes whose size is a multiple of them
+    // (see slotAlignment()).
+    //
+    template<std::size_t... Sizes>
+    struct SizeClasses
+    {
+        static constexpr std::size_t count{sizeof...(Sizes)};
+        static constexpr std::array<std::size_t, count> sizes{Sizes...};
+
+        static_assert(count > 0, "At least one size class is required");
+        static_assert(count <= std::numeric_limits<uint8_t>::max(),
+                      "Too many size classes for an 8-bit lookup table");
+        static_assert(((Sizes >= 16 && Sizes % 16 == 0) && ...),
+                      "Size classes must be multiples of 16 bytes");
+        static_assert(std::ranges::adjacent_find(sizes, std::ranges::greater_equal{}) == sizes.end(),
+                      "Size classes must be strictly increasing");
+    };
+
+    // The original 12 classes: 16 bytes to 1 KB with intermediate steps
+    using DefaultSizeClasses = SizeClasses<16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1_KB>;
+
+
+    //
+    // BasicPool routes each allocation to the small slab for its size class,
+    // or to SlabProxy beyond the largest class. The size-class table is a
+    // template parameter, so the dispatch table and slab set are generated
+    // at compile time for each table; Pool is the default instantiation.
+    //
+    template<typename SizeClassTable, Lockable Lock = SpinLock>
+    class BasicPool
+    {
+    public: // types
+        static constexpr std::size_t size_class_count{SizeClassTable::count};
+
+        // element size of each small slab, indexed by selectSlab() result
+        static constexpr std::array<std::size_t, size_class_count> size_classes{SizeClassTable::sizes};
+
+        struct Config
+        {
+            CacheMode cache_mode{CacheMode::per_thread};
+
+            // Number of free slots each cache may keep per size class before
+            // flushing half of them back to the slab. Refills and flushes
+            // move depth/2 items under a single slab lock. 0 disables the
+            // cache for that size class.
+            std::array<std::size_t, size_class_count> thread_cache_depth{defaultThreadCacheDepths()};
+
+            // Slot tracking engine for each size class, so engines can be
+            // compared side by side under the same workload
+            std::array<SlabEngine, size_class_count> slab_engine{filledArray(SlabEngine::bitmap)};
+
+            // Page size and prefaulting for all of this pool's slab memory
+            // and mapped large blocks
+            PagePolicy page_policy{};
+
+            // What trim() and the scavenger release, and how often the
+            // background scavenger runs; zero means no scavenger thread and
+            // memory is only returned by explicit trim() calls
+            TrimPolicy trim_policy{};
+            std::chrono::milliseconds scavenge_interval{0};
+
+            // Count allocations, frees and requested bytes for stats().
+            // Each thread bumps its own relaxed counters, so the cost is a
+            // few plain loads and stores per call.
+            bool collect_stats{false};
+        };
+
+        struct Stats
+        {
+            std::array<SizeClassStats, size_class_count> size_classes;
+            SizeClassStats large;       // SlabProxy blocks and page slots
+        };
+
     public: // methods
+        // `alignment` may be any power of two up to max_slot_alignment (a
+        // page). Up to 16 bytes every class qualifies; beyond that the
+        // request is served by the smallest class that fits and whose slot
+        // size is a multiple of the alignment, so no padding is added.
+        // Requests up to a page that no class can align get a page-sized
+        // slot from a dedicated slab.
         std::byte* allocate(std::size_t size, std::size_t alignment = 8);
+
+        // As allocate(), with the first `size` bytes zeroed (calloc). Slots
+        // and large blocks that have never been written since their pages
+        // were mapped are known to be zero and aren't cleared, including
+        // fresh slots refilled into a thread or per-CPU cache, so a large
+        // zeroed block doesn't touch pages until they are used.
+        std::byte* allocateZeroed(std::size_t size, std::size_t alignment = 8);
         void deallocate(std::byte* item);
 
-        Pool();
-        ~Pool() = default;
+        // Sized deallocation: `size` and `alignment` must be the ones passed
+        // to allocate(). The size class comes straight from them (compile-
+        // time constants for PoolDeleter and PoolAllocator<T> with fixed n),
+        // so the page map isn't consulted except to verify in debug builds.
+        void deallocate(std::byte* item, std::size_t size, std::size_t alignment = 8);
+
+        // Resize an allocation, preserving its contents up to the smaller
+        // of the two sizes. Returns `item` itself if `size` still maps to
+        // its size class (or fits its large block); otherwise the data
+        // moves to the class for `size`, so a later sized deallocate()
+        // with `size` is always valid. Mapped large blocks that stay large are resized
+        // with mremap where available, moving pages instead of copying.
+        // A null `item` allocates; the result honors `alignment` like
+        // allocate().
+        std::byte* reallocate(std::byte* item, std::size_t size, std::size_t alignment = 8);
+
+        // Batch variants: allocate items.size() blocks of `size` bytes, or
+        // free a span of blocks, taking each slab lock once per batch
+        // rather than once per item. These bypass the thread cache, which
+        // exists to amortize exactly that cost for single calls.
+        // allocateBatch fills every entry or throws, freeing any partial
+        // batch. deallocateBatch frees every valid item and then throws for
+        // the first invalid one, if any; the sized overload requires every
+        // item to have been allocated with `size`.
+        void allocateBatch(std::size_t size, std::span<std::byte*> items);
+        void deallocateBatch(std::span<std::byte* const> items);
+        void deallocateBatch(std::span<std::byte* const> items, std::size_t size);
+
+        // Return idle empty spans to the OS per the configured TrimPolicy
+        // (or the one given), after flushing the calling thread's cache for
+        // this pool. Slots cached by other threads keep their spans in use.
+        // Returns the bytes released.
+        std::size_t trim();
+        std::size_t trim(const TrimPolicy& policy);
+
+        std::size_t getThreadCacheDepth(std::size_t slab_index) const
+        {
+            return config.thread_cache_depth.at(slab_index);
+        }
+
+        // The cache mode in effect, after any per_cpu fallback
+        CacheMode getCacheMode() const { return cache_mode; }
+
+        // Lock statistics of each size class's slab, indexed like
+        // size_classes. Only an instrumented lock (InstrumentedSpinLock,
+        // or SpinLock built with SPALLOC_LOCK_STATS) records anything;
+        // other lock types report zeros.
+        std::array<LockStatsSnapshot, size_class_count> lockStats() const
+        {
+            std::array<LockStatsSnapshot, size_class_count> stats;
+            for (std::size_t i = 0; i < size_class_count; ++i)
+            {
+                stats[i] = small_slabs[i]->lockStats();
+            }
+            return stats;
+        }
+
+        // Snapshot of every size class and of the large blocks. Slabs are
+        // visited one at a time, so the entries aren't mutually consistent
+        // while other threads use the pool. Without collect_stats the
+        // counts are zero and slots cached by threads count as live.
+        Stats stats();
+
+        BasicPool();
+        explicit BasicPool(const Config& config);
+        ~BasicPool();
+
+        // Map an allocation size to its small slab index,
+        // or std::numeric_limits<std::size_t>::max() for SlabProxy. A single
+        // table load; usable at compile time.
+        static constexpr std::size_t selectSlab(std::size_t size);
 
-        constexpr::size_t selectSlab(std::size_t size) const;
+        // As above, but for a slot aligned to `alignment`
+        static constexpr std::size_t selectSlab(std::size_t size, std::size_t alignment);
 
     private: // methods
-        Pool(const Pool&) = delete;
-        Pool& operator=(const Pool&) = delete;
-        Pool(Pool&&) = delete;
-        Pool& operator=(Pool&&) = delete;
+        BasicPool(const BasicPool&) = delete;
+        BasicPool& operator=(const BasicPool&) = delete;
+        BasicPool(BasicPool&&) = delete;
+        BasicPool& operator=(BasicPool&&) = delete;
+
+        template<typename T>
+        static constexpr std::array<T, size_class_count> filledArray(T value)
+        {
+            std::array<T, size_class_count> values{};
+            values.fill(value);
+            return values;
+        }
+
+        // Keep roughly 8 KB worth of items per class, but never fewer than 8
+        // (so large classes still batch) or more than 64 (so tiny classes
+        // don't hoard thousands of slots per thread)
+        static constexpr std::array<std::size_t, size_class_count> defaultThreadCacheDepths()
+        {
+            std::array<std::size_t, size_class_count> depths{};
+            for (std::size_t i = 0; i < size_class_count; ++i)
+            {
+                depths[i] = std::clamp<std::size_t>(8_KB / size_classes[i], 8, 64);
+            }
+            return depths;
+        }
+
+        template<bool Zeroed>
+        std::byte* allocateImpl(std::size_t size, std::size_t alignment);
+
+        void deallocateSmall(std::size_t slab_index, std::byte* item);
+        void deallocateLarge(std::byte* item);
+        void deallocatePageSlot(std::byte* item);
+
+        // Debug builds check that a sized free names the class the item
+        // was actually allocated from
+        void verifySizedFree(std::byte* item, std::size_t size, std::size_t alignment) const;
+
+        // True for a request up to a page whose alignment no size class
+        // meets; it gets a page slot, which meets any supported alignment
+        static constexpr bool needsPageSlot(std::size_t size, std::size_t alignment)
+        {
+            return alignment > 16 && size <= max_slot_alignment &&
+                   selectSlab(size, alignment) >= size_class_count;
+        }
+
+        std::size_t trimSlabs(const TrimPolicy& policy);
+        void scavenge(std::stop_token stop);
+
+        // Outside CacheMode::per_thread the thread's cache only holds its
+        // statistics counters, so all of its bins are disabled
+        ThreadCache& threadCache()
+        {
+            static constexpr std::array<std::size_t, size_class_count> no_cache_depth{};
+            return ThreadCacheSet::get(cache_registry, (cache_mode == CacheMode::per_thread) ?
+                                       std::span<const std::size_t>(config.thread_cache_depth) : no_cache_depth);
+        }
+
+        // Record operations for stats(); large blocks are counted under
+        // index size_class_count
+        void countAllocations(std::size_t slab_index, std::size_t count, std::size_t size)
+        {
+            if (config.collect_stats)
+            {
+                threadCache().countAllocations(std::min(slab_index, size_class_count), count, size * count);
+            }
+        }
+
+        void countFrees(std::size_t slab_index, std::size_t count)
+        {
+            if (config.collect_stats)
+            {
+                threadCache().countFrees(std::min(slab_index, size_class_count), count);
+            }
+        }
+
+        // Try the configured cache; nullptr/false means go to the slab
+        std::byte* cachedAllocate(std::size_t slab_index, AbstractSlab* slab, std::size_t size, bool* fresh);
+        bool cachedDeallocate(std::size_t slab_index, AbstractSlab* slab, std::byte* item);
+
+        static CacheMode resolveCacheMode(CacheMode requested)
+        {
+            return (requested == CacheMode::per_cpu && !PerCpuCache::supported()) ? CacheMode::none : requested;
+        }
+
+        using SlabArray = std::array<std::unique_ptr<AbstractSlab>, size_class_count>;
+        static SlabArray makeSlabs(const Config& config);
+
+        template<std::size_t ElemSize>
+        static std::unique_ptr<AbstractSlab> makeSlab(SlabEngine engine, const PagePolicy& policy);
+
+        // Size class lookup table: entry i is the slab index for sizes in
+        // ((i - 1) * granularity, i * granularity]. Every size class is a
+        // multiple of the granularity, so this is exact.
+        static constexpr std::size_t size_class_granularity{16};
+        static constexpr std::size_t max_small_size{size_classes.back()};
+        using SizeClassLookup = std::array<uint8_t, max_small_size / size_class_granularity + 1>;
+        static constexpr SizeClassLookup makeSizeClassLookup();
+        static const SizeClassLookup size_class_lookup;
 
     private: // data members
-        std::vector<std::unique_ptr<AbstractSlab>> small_slabs;
+        // Filled in by the constructor and never modified afterwards, so
+        // allocate() and deallocate() can index it without any locking; the
+        // only synchronization left is inside the chosen slab.
+        const SlabArray small_slabs;
         SlabProxy large_slab;
+        // page-sized slots for over-aligned requests (see needsPageSlot());
+        // counted with the large blocks in stats()
+        const std::unique_ptr<AbstractSlab> page_slab;
 
-        SpinLock lock;
+        Config config;
+        const CacheMode cache_mode;
+        std::shared_ptr<ThreadCacheRegistry> cache_registry;
+        std::unique_ptr<PerCpuCache> cpu_cache;
+
+        // Declared last so it is stopped and joined before anything it
+        // trims is destroyed
+        std::mutex scavenge_mutex;
+        std::condition_variable_any scavenge_wakeup;
+        std::jthread scavenger;
     };
 
 
-    std::byte* Pool::allocate(std::size_t item_size, std::size_t alignment /* = 8 */)
+    template<typename SizeClassTable, Lockable Lock>
+    constexpr typename BasicPool<SizeClassTable, Lock>::SizeClassLookup BasicPool<SizeClassTable, Lock>::makeSizeClassLookup()
+    {
+        static_assert(std::ranges::all_of(size_classes,
+                          [](std::size_t size) { return size % size_class_granularity == 0; }),
+                      "Size classes must be multiples of the lookup granularity");
+
+        SizeClassLookup lookup{};
+        std::size_t slab_index = 0;
+        for (std::size_t i = 0; i < lookup.size(); ++i)
+        {
+            while (i * size_class_granularity > size_classes[slab_index])
+            {
+                ++slab_index;
+            }
+            lookup[i] = uint8_t(slab_index);
+        }
+        return lookup;
+    }
+
+    template<typename SizeClassTable, Lockable Lock>
+    inline constexpr typename BasicPool<SizeClassTable, Lock>::SizeClassLookup
+        BasicPool<SizeClassTable, Lock>::size_class_lookup{BasicPool<SizeClassTable, Lock>::makeSizeClassLookup()};
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    std::byte* BasicPool<SizeClassTable, Lock>::allocate(std::size_t item_size, std::size_t alignment /* = 8 */)
+    {
+        return allocateImpl<false>(item_size, alignment);
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    std::byte* BasicPool<SizeClassTable, Lock>::allocateZeroed(std::size_t item_size, std::size_t alignment /* = 8 */)
+    {
+        return allocateImpl<true>(item_size, alignment);
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    template<bool Zeroed>
+    std::byte* BasicPool<SizeClassTable, Lock>::allocateImpl(std::size_t item_size, std::size_t alignment)
     {
         Allocation alloc;
         alloc.size = item_size;
@@ -83,122 +443,628 @@ namespace spallocator
             throw std::out_of_range("Allocation size exceeds maximum limit for pool allocator");
         }
 
-        runtime_assert((alignment >= 4) && ((alignment & (alignment - 1)) == 0),
-            "Alignment must be a power of two and at least 4 bytes");
-        runtime_assert(alignment <= 16,
-            "Alignment greater than 16 bytes is not supported");
-        if (alignment < 4 || alignment > 16)
+        if (!std::has_single_bit(alignment) || alignment > max_slot_alignment)
         {
             throw std::invalid_argument("Unsupported alignment requested");
         }
-        // ... else the slab native buffer alignment is 16, which can cover
-        // all the supported alignment requests
 
-        // Store the actual allocated size and the alignment in bytes directly
-        // before the data returned to the user. We may need to pad for
-        // alignment, but the size will always be in the preceding 4 bytes,
-        // and the alignment in the 1 byte preceding that. This allows us to
-        // use the size for quick lookup during deallocation.
-        std::size_t header_size = 8 < alignment ? alignment : 8;
-        std::size_t alloc_size = item_size + header_size;
-        alloc.size = alloc_size;
+        // No header is stored with the allocation: deallocate() finds the
+        // size class from the address alone via the page map, so the user
+        // gets the whole slot
+        auto slab_index = selectSlab(item_size, alignment);
+        debug_println("Allocating {} bytes aligned to {}, slab={}", item_size, alignment, slab_index);
 
-        AbstractSlab* slab = nullptr;
+        if (slab_index >= size_class_count)
         {
-            std::scoped_lock<SpinLock> guard(lock);
-            auto slab_index = selectSlab(alloc_size);
-            if (slab_index != std::numeric_limits<std::size_t>::max())
+            if (needsPageSlot(item_size, alignment))
+            {
+                alloc.ptr = Zeroed ? page_slab->allocateZeroedItem(item_size)
+                                   : page_slab->allocateItem(item_size);
+            }
+            else if (alignment > 16)
             {
-                slab = small_slabs[slab_index].get();
+                // aligned large blocks are always freshly mapped
+                alloc.ptr = large_slab.allocateAligned(item_size, alignment);
+                if (Zeroed && !PageAllocator::maps_zeroed)
+                {
+                    std::memset(alloc.ptr, 0, item_size);
+                }
             }
             else
             {
-                slab = &large_slab;
+                alloc.ptr = Zeroed ? large_slab.allocateZeroedItem(item_size)
+                                   : large_slab.allocateItem(item_size);
+            }
+            countAllocations(slab_index, 1, item_size);
+            return alloc.ptr;
+        }
+
+        AbstractSlab* slab = small_slabs[slab_index].get();
+        bool fresh = false;
+        alloc.ptr = cachedAllocate(slab_index, slab, item_size, Zeroed ? &fresh : nullptr);
+        if (alloc.ptr)
+        {
+            // slots refilled into the cache keep their fresh mark until
+            // handed out; anything freed into it has been used
+            if (Zeroed && !fresh)
+            {
+                std::memset(alloc.ptr, 0, item_size);
             }
-            debug_println("Allocated {} bytes, slab={}", alloc_size,
-                          (slab == &large_slab) ? "large_slab" : std::format("small_slab {}", slab_index));
+            countAllocations(slab_index, 1, item_size);
+            return alloc.ptr;
         }
-        alloc.ptr = slab->allocateItem(alloc_size);
+        alloc.ptr = Zeroed ? slab->allocateZeroedItem(item_size)
+                           : slab->allocateItem(item_size);
+        countAllocations(slab_index, 1, item_size);
+        return alloc.ptr;
+    }
 
-        uint32_t* size_ptr = reinterpret_cast<uint32_t*>(alloc.ptr + header_size - 4);
-        *size_ptr = uint32_t(alloc_size & 0xffffffff);
 
-        uint8_t* header_size_ptr = reinterpret_cast<uint8_t*>(alloc.ptr + header_size - 5);
-        *header_size_ptr = uint8_t(header_size & 0xff);
+    template<typename SizeClassTable, Lockable Lock>
+    void BasicPool<SizeClassTable, Lock>::deallocate(std::byte* item)
+    {
+        if (item == nullptr)
+        {
+            return;
+        }
+
+        // Every span registers itself in the page map; an address that
+        // isn't in any span must be a large block from SlabProxy
+        SpanHeader* span = PageMap::instance().lookup(item);
+        if (!span || span->owner == &large_slab)
+        {
+            debug_println("Deallocating large block at ptr={}", static_cast<void*>(item));
+            deallocateLarge(item);
+            return;
+        }
+        if (span->owner == page_slab.get())
+        {
+            deallocatePageSlot(item);
+            return;
+        }
 
-        return alloc.ptr + header_size;
+        auto slab_index = selectSlab(span->elem_size);
+        if (slab_index >= size_class_count || span->owner != small_slabs[slab_index].get())
+        {
+            throw std::invalid_argument("Invalid item pointer; allocated by a different pool");
+        }
+        debug_println("Deallocating ptr={}, slab={}", static_cast<void*>(item), slab_index);
+        deallocateSmall(slab_index, item);
     }
 
 
-    void Pool::deallocate(std::byte* item)
+    template<typename SizeClassTable, Lockable Lock>
+    void BasicPool<SizeClassTable, Lock>::deallocate(std::byte* item, std::size_t size, std::size_t alignment /* = 8 */)
     {
         if (item == nullptr)
         {
             return;
         }
 
-        uint32_t* size_ptr = reinterpret_cast<uint32_t*>(item - 4);
-        std::size_t alloc_size = *size_ptr;
+        auto slab_index = selectSlab(size, alignment);
+        verifySizedFree(item, size, alignment);
 
-        uint8_t* header_size_ptr = reinterpret_cast<uint8_t*>(item - 5);
-        uint8_t header_size = *header_size_ptr;
+        debug_println("Deallocating {} bytes at ptr={}, slab={}", size, static_cast<void*>(item), slab_index);
+        if (needsPageSlot(size, alignment))
+        {
+            deallocatePageSlot(item);
+            return;
+        }
+        if (slab_index >= size_class_count)
+        {
+            deallocateLarge(item);
+            return;
+        }
+        deallocateSmall(slab_index, item);
+    }
 
-        std::byte* original_ptr = item - header_size;
 
-        AbstractSlab* slab = nullptr;
+    template<typename SizeClassTable, Lockable Lock>
+    void BasicPool<SizeClassTable, Lock>::verifySizedFree(std::byte* item, std::size_t size, std::size_t alignment) const
+    {
+        if constexpr (DEBUG_BUILD)
         {
-            std::scoped_lock<SpinLock> guard(lock);
-            auto slab_index = selectSlab(alloc_size);
-            if (slab_index != std::numeric_limits<std::size_t>::max())
+            auto slab_index = selectSlab(size, alignment);
+            SpanHeader* span = PageMap::instance().lookup(item);
+            bool large = !span || span->owner == &large_slab;
+            bool page = span && span->owner == page_slab.get();
+            runtime_assert(page ? needsPageSlot(size, alignment)
+                                : large ? (slab_index >= size_class_count && !needsPageSlot(size, alignment))
+                                        : (slab_index < size_class_count &&
+                                           span->owner == small_slabs[slab_index].get()),
+                std::format("Sized deallocate of {} bytes does not match the allocation at {}",
+                            size, static_cast<void*>(item)));
+        }
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    std::byte* BasicPool<SizeClassTable, Lock>::reallocate(std::byte* item, std::size_t size, std::size_t alignment /* = 8 */)
+    {
+        if (item == nullptr)
+        {
+            return allocate(size, alignment);
+        }
+        if (size > 1_GB)
+        {
+            throw std::out_of_range("Allocation size exceeds maximum limit for pool allocator");
+        }
+
+        std::size_t old_size = 0;
+        SpanHeader* span = PageMap::instance().lookup(item);
+        bool large = !span || span->owner == &large_slab;
+        bool page = span && span->owner == page_slab.get();
+        if (large)
+        {
+            old_size = large_slab.usableSize(item);
+            bool aligned = (reinterpret_cast<std::uintptr_t>(item) & (alignment - 1)) == 0;
+            if (aligned && selectSlab(size, alignment) >= size_class_count && !needsPageSlot(size, alignment))
             {
-                slab = small_slabs[slab_index].get();
+                // staying large: mapped blocks are resized by remapping
+                // (which also gives back the tail on a shrink), others
+                // stay put if their class is big enough
+                if (span && size >= SlabProxy::mmap_threshold)
+                {
+                    // counted like the move it replaces: a new block of
+                    // `size` and a free of the old one
+                    std::byte* new_item = large_slab.remapItem(item, size);
+                    countAllocations(size_class_count, 1, size);
+                    countFrees(size_class_count, 1);
+                    return new_item;
+                }
+                if (!span && size <= old_size)
+                {
+                    return item;
+                }
             }
-            else
+        }
+        else if (page)
+        {
+            old_size = span->elem_size;
+            if (needsPageSlot(size, alignment))
+            {
+                return item;
+            }
+        }
+        else
+        {
+            auto slab_index = selectSlab(span->elem_size);
+            if (slab_index >= size_class_count || span->owner != small_slabs[slab_index].get())
+            {
+                throw std::invalid_argument("Invalid item pointer; allocated by a different pool");
+            }
+            old_size = span->elem_size;
+            // only stay put if the new size maps to the same class: a sized
+            // free of `size` must find the slot in the class it came from
+            if (selectSlab(size, alignment) == slab_index)
             {
-                slab = &large_slab;
+                return item;
             }
-            debug_println("Deallocating {} bytes at ptr={}, slab={}",
-                          alloc_size, static_cast<void*>(original_ptr),
-                          (slab == &large_slab) ? "large_slab" : std::format("small_slab {}", slab_index));
         }
-        slab->deallocateItem(original_ptr);
+
+        std::byte* new_item = allocate(size, alignment);
+        std::memcpy(new_item, item, std::min(old_size, size));
+        debug_println("Reallocated {} -> {} bytes, ptr={} -> {}", old_size, size,
+                      static_cast<void*>(item), static_cast<void*>(new_item));
+        if (large)
+        {
+            deallocateLarge(item);
+        }
+        else if (page)
+        {
+            deallocatePageSlot(item);
+        }
+        else
+        {
+            deallocateSmall(selectSlab(span->elem_size), item);
+        }
+        return new_item;
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    void BasicPool<SizeClassTable, Lock>::allocateBatch(std::size_t size, std::span<std::byte*> items)
+    {
+        if (size > 1_GB)
+        {
+            throw std::out_of_range("Allocation size exceeds maximum limit for pool allocator");
+        }
+
+        auto slab_index = selectSlab(size);
+        AbstractSlab* slab = (slab_index < size_class_count) ?
+                             small_slabs[slab_index].get() : &large_slab;
+        std::size_t count = 0;
+        try
+        {
+            while (count < items.size())
+            {
+                // a slab returns a short batch only when it runs out of
+                // memory, and the next call then throws
+                count += slab->allocateBatch(size, items.subspan(count));
+            }
+        }
+        catch (...)
+        {
+            slab->deallocateBatch(items.first(count));
+            throw;
+        }
+        countAllocations(slab_index, items.size(), size);
+        debug_println("Batch allocated {} x {} bytes, slab={}", items.size(), size, slab_index);
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    void BasicPool<SizeClassTable, Lock>::deallocateBatch(std::span<std::byte* const> items)
+    {
+        // Hand each run of consecutive items from the same slab over in
+        // one call; batches from allocateBatch are a single run
+        std::exception_ptr error;
+        std::size_t run_start = 0;
+        AbstractSlab* run_slab = nullptr;
+        std::size_t run_index = 0;
+        std::size_t run_nulls = 0;
+        for (std::size_t i = 0; i <= items.size(); ++i)
+        {
+            if (i < items.size() && !items[i])
+            {
+                // null entries are no-ops; they ride along in the current
+                // run but aren't counted as frees
+                if (run_slab)
+                {
+                    ++run_nulls;
+                }
+                else
+                {
+                    run_start = i + 1;
+                }
+                continue;
+            }
+
+            AbstractSlab* slab = nullptr;
+            std::size_t slab_index = size_class_count;
+            if (i < items.size())
+            {
+                SpanHeader* span = PageMap::instance().lookup(items[i]);
+                if (!span || span->owner == &large_slab)
+                {
+                    slab = &large_slab;
+                }
+                else if (span->owner == page_slab.get())
+                {
+                    slab = page_slab.get();
+                }
+                else
+                {
+                    slab_index = selectSlab(span->elem_size);
+                    if (slab_index < size_class_count && span->owner == small_slabs[slab_index].get())
+                    {
+                        slab = small_slabs[slab_index].get();
+                    }
+                }
+            }
+            if (i < items.size() && slab == run_slab && slab)
+            {
+                continue;
+            }
+
+            try
+            {
+                if (run_slab)
+                {
+                    countFrees(run_index, i - run_start - run_nulls);
+                    run_slab->deallocateBatch(items.subspan(run_start, i - run_start));
+                }
+                if (i < items.size() && !slab)
+                {
+                    throw std::invalid_argument("Invalid item pointer; allocated by a different pool");
+                }
+            }
+            catch (const std::invalid_argument&)
+            {
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+            run_start = slab ? i : i + 1;
+            run_slab = slab;
+            run_index = slab_index;
+            run_nulls = 0;
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    void BasicPool<SizeClassTable, Lock>::deallocateBatch(std::span<std::byte* const> items, std::size_t size)
+    {
+        auto slab_index = selectSlab(size);
+        AbstractSlab* slab = (slab_index < size_class_count) ?
+                             small_slabs[slab_index].get() : &large_slab;
+        std::size_t count = 0;
+        for (auto item : items)
+        {
+            if (item)
+            {
+                verifySizedFree(item, size, 8);
+                ++count;
+            }
+        }
+        countFrees(slab_index, count);
+        slab->deallocateBatch(items);
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    void BasicPool<SizeClassTable, Lock>::deallocateSmall(std::size_t slab_index, std::byte* item)
+    {
+        // count only once the cache or slab has accepted the free
+        AbstractSlab* slab = small_slabs[slab_index].get();
+        if (!cachedDeallocate(slab_index, slab, item))
+        {
+            slab->deallocateItem(item);
+        }
+        countFrees(slab_index, 1);
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    void BasicPool<SizeClassTable, Lock>::deallocateLarge(std::byte* item)
+    {
+        large_slab.deallocateItem(item);
+        countFrees(size_class_count, 1);
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    void BasicPool<SizeClassTable, Lock>::deallocatePageSlot(std::byte* item)
+    {
+        page_slab->deallocateItem(item);
+        countFrees(size_class_count, 1);
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    std::byte* BasicPool<SizeClassTable, Lock>::cachedAllocate(std::size_t slab_index, AbstractSlab* slab, std::size_t size, bool* fresh)
+    {
+        switch (cache_mode)
+        {
+            case CacheMode::per_thread:
+                return threadCache().allocate(slab_index, slab, size, fresh);
+            case CacheMode::per_cpu:
+                return cpu_cache->allocate(slab_index, slab, size, fresh);
+            case CacheMode::none:
+            default:
+                return nullptr;
+        }
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    bool BasicPool<SizeClassTable, Lock>::cachedDeallocate(std::size_t slab_index, AbstractSlab* slab, std::byte* item)
+    {
+        switch (cache_mode)
+        {
+            case CacheMode::per_thread:
+                return threadCache().deallocate(slab_index, slab, item);
+            case CacheMode::per_cpu:
+                return cpu_cache->deallocate(slab_index, slab, item);
+            case CacheMode::none:
+            default:
+                return false;
+        }
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    std::size_t BasicPool<SizeClassTable, Lock>::trim()
+    {
+        return trim(config.trim_policy);
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    std::size_t BasicPool<SizeClassTable, Lock>::trim(const TrimPolicy& policy)
+    {
+        if (cache_mode == CacheMode::per_thread)
+        {
+            threadCache().flush();
+        }
+        else if (cache_mode == CacheMode::per_cpu)
+        {
+            cpu_cache->flush();
+        }
+        return trimSlabs(policy);
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    std::size_t BasicPool<SizeClassTable, Lock>::trimSlabs(const TrimPolicy& policy)
+    {
+        std::size_t released = 0;
+        for (auto& slab : small_slabs)
+        {
+            released += slab->trim(policy);
+        }
+        released += large_slab.trim(policy);
+        released += page_slab->trim(policy);
+        return released;
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    typename BasicPool<SizeClassTable, Lock>::Stats BasicPool<SizeClassTable, Lock>::stats()
+    {
+        // the counters of live threads plus those of threads that exited
+        std::vector<ClassCounts> counts;
+        {
+            std::scoped_lock<SpinLock> guard(cache_registry->lock);
+            counts = cache_registry->retired;
+            for (auto cache : cache_registry->caches)
+            {
+                cache->addCounts(counts);
+            }
+        }
+        counts.resize(size_class_count + 1);
+
+        auto fill = [](SizeClassStats& entry, const SlabUsage& usage, const ClassCounts& count) {
+            entry.span_count = usage.spans;
+            entry.reserved_bytes = usage.reserved_bytes;
+            entry.peak_reserved_bytes = usage.peak_reserved_bytes;
+            entry.requested_bytes = count.requested_bytes;
+            entry.allocations = count.allocations;
+            entry.frees = count.frees;
+        };
+
+        Stats result;
+        for (std::size_t i = 0; i < size_class_count; ++i)
+        {
+            SizeClassStats& entry = result.size_classes[i];
+            SlabUsage usage = small_slabs[i]->usage();
+            fill(entry, usage, counts[i]);
+            entry.elem_size = size_classes[i];
+            entry.free_slots = usage.slots - usage.used_slots;
+            entry.live_items = usage.used_slots;
+            if (config.collect_stats)
+            {
+                // the counters were read before the slab, and a free on one
+                // thread can be seen without the allocation on another
+                uint64_t live = counts[i].allocations - std::min(counts[i].frees, counts[i].allocations);
+                entry.live_items = std::min<std::size_t>(live, usage.used_slots);
+                entry.cached_items = usage.used_slots - entry.live_items;
+            }
+        }
+
+        SlabUsage usage = large_slab.usage();
+        fill(result.large, usage, counts[size_class_count]);
+        result.large.live_items = usage.used_slots;
+        result.large.cached_items = usage.slots - usage.used_slots;
+
+        SlabUsage page_usage = page_slab->usage();
+        result.large.live_items += page_usage.used_slots;
+        result.large.free_slots = page_usage.slots - page_usage.used_slots;
+        result.large.span_count += page_usage.spans;
+        result.large.reserved_bytes += page_usage.reserved_bytes;
+        result.large.peak_reserved_bytes += page_usage.peak_reserved_bytes;
+        return result;
+    }
+
+
+    template<typename SizeClassTable, Lockable Lock>
+    void BasicPool<SizeClassTable, Lock>::scavenge(std::stop_token stop)
+    {
+        // The scavenger never allocates from the pool, so it has no thread
+        // cache of its own to flush
+        std::unique_lock lock(scavenge_mutex);
+        while (!scavenge_wakeup.wait_for(lock, stop, config.scavenge_interval,
+                                         [&stop] { return stop.stop_requested(); }))
+        {
+            std::size_t released = trimSlabs(config.trim_policy);
+            debug_println("Scavenger released {} bytes", released);
+        }
     }
 
 
-    constexpr std::size_t Pool::selectSlab(std::size_t size) const
+    template<typename SizeClassTable, Lockable Lock>
+    constexpr std::size_t BasicPool<SizeClassTable, Lock>::selectSlab(std::size_t size)
     {
-        if (size <= 16) return 0;
-        else if (size <= 32) return 1;
-        else if (size <= 48) return 2;
-        else if (size <= 64) return 3;
-        else if (size <= 96) return 4;
-        else if (size <= 128) return 5;
-        else if (size <= 192) return 6;
-        else if (size <= 256) return 7;
-        else if (size <= 384) return 8;
-        else if (size <= 512) return 9;
-        else if (size <= 768) return 10;
-        else if (size <= 1_KB) return 11;
-        else return std::numeric_limits<std::size_t>::max(); // indicates large slab
+        if (size > max_small_size)
+        {
+            return std::numeric_limits<std::size_t>::max(); // indicates large slab
+        }
+        return size_class_lookup[(size + size_class_granularity - 1) / size_class_granularity];
     }
 
-    Pool::Pool()
+    template<typename SizeClassTable, Lockable Lock>
+    constexpr std::size_t BasicPool<SizeClassTable, Lock>::selectSlab(std::size_t size, std::size_t alignment)
     {
-        // create slabs for small sizes (up to 1KB)
-        small_slabs.push_back(std::make_unique<Slab<16>>());   // 0
-        small_slabs.push_back(std::make_unique<Slab<32>>());   // 1
-        small_slabs.push_back(std::make_unique<Slab<48>>());   // 2
-        small_slabs.push_back(std::make_unique<Slab<64>>());   // 3
-        small_slabs.push_back(std::make_unique<Slab<96>>());   // 4
-        small_slabs.push_back(std::make_unique<Slab<128>>());  // 5
-        small_slabs.push_back(std::make_unique<Slab<192>>());  // 6
-        small_slabs.push_back(std::make_unique<Slab<256>>());  // 7
-        small_slabs.push_back(std::make_unique<Slab<384>>());  // 8
-        small_slabs.push_back(std::make_unique<Slab<512>>());  // 9
-        small_slabs.push_back(std::make_unique<Slab<768>>());  // 10
-        small_slabs.push_back(std::make_unique<Slab<1_KB>>()); // 11
+        auto slab_index = selectSlab(size);
+        if (alignment <= 16)
+        {
+            return slab_index;
+        }
+        // only over-aligned requests walk the classes; there are few, and
+        // the walk is constant-folded for compile-time alignments
+        for (; slab_index < size_class_count; ++slab_index)
+        {
+            if (slotAlignment(size_classes[slab_index]) >= alignment)
+            {
+                return slab_index;
+            }
+        }
+        return std::numeric_limits<std::size_t>::max();
     }
 
+    template<typename SizeClassTable, Lockable Lock>
+    template<std::size_t ElemSize>
+    std::unique_ptr<AbstractSlab> BasicPool<SizeClassTable, Lock>::makeSlab(SlabEngine engine, const PagePolicy& policy)
+    {
+        switch (engine)
+        {
+            case SlabEngine::freelist:
+                return std::make_unique<FreeListSlab<ElemSize, Lock>>(policy);
+            case SlabEngine::atomic_bitmap:
+                return std::make_unique<AtomicSlab<ElemSize, Lock>>(policy);
+            case SlabEngine::bitmap:
+            default:
+                return std::make_unique<Slab<ElemSize, Lock>>(policy);
+        }
+    }
+
+    template<typename SizeClassTable, Lockable Lock>
+    typename BasicPool<SizeClassTable, Lock>::SlabArray BasicPool<SizeClassTable, Lock>::makeSlabs(const Config& config)
+    {
+        // create one slab per entry in size_classes (up to 1KB)
+        return [&config]<std::size_t... Index>(std::index_sequence<Index...>) {
+            return SlabArray{makeSlab<size_classes[Index]>(config.slab_engine[Index], config.page_policy)...};
+        }(std::make_index_sequence<size_class_count>{});
+    }
+
+    template<typename SizeClassTable, Lockable Lock>
+    BasicPool<SizeClassTable, Lock>::BasicPool()
+        : BasicPool(Config{})
+    {
+    }
+
+    template<typename SizeClassTable, Lockable Lock>
+    BasicPool<SizeClassTable, Lock>::BasicPool(const Config& pool_config)
+        : small_slabs(makeSlabs(pool_config)),
+          large_slab(pool_config.page_policy),
+          page_slab(makeSlab<max_slot_alignment>(SlabEngine::bitmap, pool_config.page_policy)),
+          config(pool_config),
+          cache_mode(resolveCacheMode(pool_config.cache_mode)),
+          cache_registry(std::make_shared<ThreadCacheRegistry>())
+    {
+        if (cache_mode == CacheMode::per_cpu)
+        {
+            cpu_cache = std::make_unique<PerCpuCache>(cache_registry, config.thread_cache_depth);
+        }
+        if (config.scavenge_interval.count() > 0)
+        {
+            scavenger = std::jthread([this](std::stop_token stop) { scavenge(stop); });
+        }
+    }
+
+    template<typename SizeClassTable, Lockable Lock>
+    BasicPool<SizeClassTable, Lock>::~BasicPool()
+    {
+        // Threads that used this pool may still be running and holding
+        // cached slots; make sure none of them try to flush into the slabs
+        // we are about to destroy.
+        std::scoped_lock<SpinLock> guard(cache_registry->lock);
+        cache_registry->pool_alive = false;
+        for (auto cache : cache_registry->caches)
+        {
+            cache->detach();
+        }
+    }
+
+
+    using Pool = BasicPool<DefaultSizeClasses>;
+
 }; // namespace spallocator
 
 
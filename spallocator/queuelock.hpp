@@ -0,0 +1,343 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2025, Michael VanLoon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QUEUELOCK_HPP_
+#define QUEUELOCK_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "spinlock.hpp"
+
+
+//
+// FIFO queue locks for heavily contended slabs. SpinLock hands the lock to
+// whichever waiter happens to see it free first, so under sustained
+// contention one thread can lose every race for milliseconds; these grant
+// it strictly in arrival order. Both spin briefly, like SpinLock, then park
+// on a futex, since a FIFO lock whose next owner has been descheduled
+// would otherwise stall everyone queued behind it.
+//
+
+
+//
+// Ticket lock: take a number, wait for it to be served. Two counters and no
+// per-waiter state, but every waiter watches the same word, so each
+// release wakes all parked waiters to find the one whose turn it is.
+//
+class TicketLock
+{
+public:
+    TicketLock() = default;
+    ~TicketLock() = default;
+
+    void lock()
+    {
+        uint32_t ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+        for (int i = 0; i < spin_limit; ++i)
+        {
+            if (now_serving.load(std::memory_order_acquire) == ticket)
+            {
+                TSAN_ANNOTATE_HAPPENS_AFTER(this);
+                return;
+            }
+            cpuRelax();
+        }
+
+        // same handshake as SpinLock: the waiter count is raised before
+        // the final check, and unlock() reads it after its store
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        for (uint32_t serving; (serving = now_serving.load(std::memory_order_seq_cst)) != ticket; )
+        {
+            now_serving.wait(serving, std::memory_order_relaxed);
+        }
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        TSAN_ANNOTATE_HAPPENS_AFTER(this);
+    }
+
+    bool try_lock()
+    {
+        // only take a ticket that would be served immediately; next_ticket
+        // can't move past an unserved ticket, so a successful exchange
+        // means nobody holds or is queued for the lock
+        uint32_t serving = now_serving.load(std::memory_order_acquire);
+        uint32_t expected = serving;
+        if (next_ticket.compare_exchange_strong(expected, serving + 1,
+                                                std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            TSAN_ANNOTATE_HAPPENS_AFTER(this);
+            return true;
+        }
+        return false;
+    }
+
+    void unlock()
+    {
+        TSAN_ANNOTATE_HAPPENS_BEFORE(this);
+        // only the holder writes now_serving
+        now_serving.store(now_serving.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_seq_cst) != 0)
+        {
+            now_serving.notify_all();
+        }
+    }
+
+private: // methods
+    TicketLock(const TicketLock&) = delete;
+    TicketLock& operator=(const TicketLock&) = delete;
+    TicketLock(TicketLock&&) = delete;
+    TicketLock& operator=(TicketLock&&) = delete;
+
+private: // data members
+    static constexpr int spin_limit{100};
+
+    std::atomic<uint32_t> next_ticket{0};
+    std::atomic<uint32_t> now_serving{0};
+    std::atomic<uint32_t> waiters{0};
+};
+
+
+//
+// MCS lock: waiters queue as a linked list of per-waiter nodes, each
+// spinning (then parking) on its own node, so a release touches only the
+// next waiter's cache line and wakes only that waiter. Nodes come from a
+// small per-thread free list, which lets the lock keep the plain
+// lock()/unlock() interface and be held alongside other locks.
+//
+class McsLock
+{
+public:
+    McsLock() = default;
+    ~McsLock() = default;
+
+    void lock()
+    {
+        Node* node = NodeCache::acquire();
+        Node* pred = tail.exchange(node, std::memory_order_acq_rel);
+        if (pred)
+        {
+            pred->next.store(node, std::memory_order_release);
+            for (int i = 0; i < spin_limit && node->state.load(std::memory_order_acquire) != granted; ++i)
+            {
+                cpuRelax();
+            }
+            uint32_t expected = waiting;
+            if (node->state.compare_exchange_strong(expected, parked, std::memory_order_acquire))
+            {
+                while (node->state.load(std::memory_order_acquire) == parked)
+                {
+                    node->state.wait(parked, std::memory_order_relaxed);
+                }
+            }
+        }
+        holder = node;
+        TSAN_ANNOTATE_HAPPENS_AFTER(this);
+    }
+
+    bool try_lock()
+    {
+        if (tail.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        Node* node = NodeCache::acquire();
+        Node* expected = nullptr;
+        if (tail.compare_exchange_strong(expected, node, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            holder = node;
+            TSAN_ANNOTATE_HAPPENS_AFTER(this);
+            return true;
+        }
+        NodeCache::release(node);
+        return false;
+    }
+
+    void unlock()
+    {
+        TSAN_ANNOTATE_HAPPENS_BEFORE(this);
+        Node* node = holder;
+        Node* succ = node->next.load(std::memory_order_acquire);
+        if (!succ)
+        {
+            Node* expected = node;
+            if (tail.compare_exchange_strong(expected, nullptr, std::memory_order_release, std::memory_order_relaxed))
+            {
+                NodeCache::release(node);
+                return;
+            }
+            // a waiter has swapped itself in but not linked to us yet
+            while (!(succ = node->next.load(std::memory_order_acquire)))
+            {
+                cpuRelax();
+            }
+        }
+        if (succ->state.exchange(granted, std::memory_order_release) == parked)
+        {
+            succ->state.notify_one();
+        }
+        NodeCache::release(node);
+    }
+
+private: // types
+    static constexpr uint32_t granted{0};
+    static constexpr uint32_t waiting{1};
+    static constexpr uint32_t parked{2};
+
+    struct alignas(64) Node
+    {
+        std::atomic<Node*> next{nullptr};
+        std::atomic<uint32_t> state{waiting};
+        Node* free_next{nullptr};
+    };
+
+    // Per-thread free list of nodes. Nodes are never freed: a releasing
+    // thread may still be waking a node's owner after that owner has moved
+    // on, so on thread exit they go to a process-wide spare list instead.
+    // The total is bounded by the peak number of locks held or awaited at
+    // once. The list itself is a trivially destructible thread_local, so
+    // locks taken by later thread_local destructors (a ThreadCache flushing
+    // into its slabs, say) still work; once the thread has started exiting
+    // they go straight to the spare list.
+    class NodeCache
+    {
+    public:
+        static Node* acquire()
+        {
+            static thread_local Reaper reaper;
+            Node* node = free_list;
+            if (node)
+            {
+                free_list = node->free_next;
+            }
+            else
+            {
+                node = takeSpare();
+            }
+            node->next.store(nullptr, std::memory_order_relaxed);
+            node->state.store(waiting, std::memory_order_relaxed);
+            return node;
+        }
+
+        static void release(Node* node)
+        {
+            if (exiting)
+            {
+                returnSpare(node, node);
+                return;
+            }
+            node->free_next = free_list;
+            free_list = node;
+        }
+
+    private:
+        // constructed on a thread's first acquire(); hands the thread's
+        // nodes back when it exits
+        struct Reaper
+        {
+            ~Reaper()
+            {
+                exiting = true;
+                if (Node* first = free_list)
+                {
+                    Node* last = first;
+                    while (last->free_next)
+                    {
+                        last = last->free_next;
+                    }
+                    free_list = nullptr;
+                    returnSpare(first, last);
+                }
+            }
+        };
+
+        struct Spare
+        {
+            std::mutex lock;
+            Node* nodes{nullptr};
+
+            static Spare& instance()
+            {
+                // deliberately leaked, so thread exits during static
+                // destruction still find it
+                static Spare* spare = new Spare;
+                return *spare;
+            }
+        };
+
+        static Node* takeSpare()
+        {
+            Spare& spare = Spare::instance();
+            {
+                std::scoped_lock<std::mutex> guard(spare.lock);
+                if (Node* node = spare.nodes)
+                {
+                    spare.nodes = node->free_next;
+                    return node;
+                }
+            }
+            return new Node;
+        }
+
+        // push a chain linked through free_next, from first to last
+        static void returnSpare(Node* first, Node* last)
+        {
+            Spare& spare = Spare::instance();
+            std::scoped_lock<std::mutex> guard(spare.lock);
+            last->free_next = spare.nodes;
+            spare.nodes = first;
+        }
+
+        static inline thread_local Node* free_list{nullptr};
+        static inline thread_local bool exiting{false};
+    };
+
+private: // methods
+    McsLock(const McsLock&) = delete;
+    McsLock& operator=(const McsLock&) = delete;
+    McsLock(McsLock&&) = delete;
+    McsLock& operator=(McsLock&&) = delete;
+
+private: // data members
+    static constexpr int spin_limit{100};
+
+    std::atomic<Node*> tail{nullptr};
+    // the holder's node; only read and written by the holder
+    Node* holder{nullptr};
+};
+
+
+static_assert(Lockable<TicketLock>);
+static_assert(Lockable<McsLock>);
+
+
+#endif // QUEUELOCK_HPP_
@@ -33,41 +33,376 @@
 #ifndef SLAP_HPP_
 #define SLAP_HPP_
 
-#include <bitset>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <format>
 #include <iostream>
-#include <map>
+#include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <utility>
 #include <vector>
 #include <mutex>
+#include <new>
 
 #include "helper.hpp"
+#include "bitmap.hpp"
+#include "pagealloc.hpp"
+#include "pagemap.hpp"
 
 
 namespace spallocator
 {
 
+    // Largest span selectBufferSize() grows to for the sake of waste alone
+    // (also the x86-64 huge page size)
+    inline constexpr std::size_t max_span_size{2_MB};
+
+    // Target: at most 1/64 of a span lost to its header and tail
+    inline constexpr std::size_t max_span_waste_divisor{64};
+
+    // Upper bound on any slab engine's span header: 96 bytes plus one bit
+    // per slot
+    constexpr std::size_t spanHeaderBound(std::size_t slots)
+    {
+        return 96 + slots / 8;
+    }
+
+    // Bytes of a span that can't hold an item (header plus tail), using
+    // the header bound; the real figure for a slab is never larger
+    template<std::size_t ElemSize>
+    constexpr std::size_t spanWasteBound(std::size_t span_size)
+    {
+        std::size_t usable = span_size - spanDataOffset(spanHeaderBound(span_size / ElemSize), ElemSize);
+        return span_size - (usable / ElemSize) * ElemSize;
+    }
+
     template<std::size_t ElemSize>
     constexpr std::size_t selectBufferSize() {
-        // for small element sizes, pre-allocate a buffer large enough to
-        // hold multiple elements to reduce the number of allocations
-        if constexpr (ElemSize < 1_KB) {
-            return 4_KB;
-        } else {
-            return ElemSize * 4;
+        // Spans are aligned to their own size so that an item's span is
+        // found by masking its address, which requires a power of two.
+        // Pick the smallest one that holds at least four elements and
+        // wastes at most 1/max_span_waste_divisor of itself; if nothing up
+        // to max_span_size gets there, the one that wastes least.
+        std::size_t best_size = 0;
+        std::size_t best_waste = 0;
+        for (std::size_t span_size = min_span_size;
+             span_size <= max_span_size || best_size == 0;
+             span_size *= 2)
+        {
+            if (span_size - spanDataOffset(spanHeaderBound(span_size / ElemSize), ElemSize) < ElemSize * 4)
+            {
+                continue;
+            }
+            std::size_t waste = spanWasteBound<ElemSize>(span_size);
+            if (waste * max_span_waste_divisor <= span_size)
+            {
+                return span_size;
+            }
+            // compare waste fractions without division
+            if (best_size == 0 || waste * best_size < best_waste * span_size)
+            {
+                best_size = span_size;
+                best_waste = waste;
+            }
         }
+        return best_size;
     }
 
 
+    // Slot tracking strategy used by a size class; see Slab (bitmap),
+    // FreeListSlab (intrusive free lists) and AtomicSlab (lock-free bitmap)
+    enum class SlabEngine
+    {
+        bitmap,
+        freelist,
+        atomic_bitmap
+    };
+
+
+    //
+    // RemoteFreeList is a lock-free stack of freed items waiting to be
+    // returned to a slab. A free that finds the slab lock taken pushes the
+    // item here instead of waiting; whoever holds the lock next takes the
+    // whole list with one exchange and frees it in a batch. Any number of
+    // threads may push; only the lock holder takes, and since it takes
+    // everything at once (never popping single nodes) there is no ABA.
+    //
+    // The link lives in the first 8 bytes of the freed item, so pushing
+    // costs no memory.
+    //
+    class RemoteFreeList
+    {
+    public: // methods
+        void push(std::byte* item)
+        {
+            push(item, item);
+        }
+
+        // Push a chain already linked with setNext(), from first to last
+        void push(std::byte* first, std::byte* last)
+        {
+            auto last_node = reinterpret_cast<Node*>(last);
+            auto first_node = reinterpret_cast<Node*>(first);
+            Node* old_head = head.load(std::memory_order_relaxed);
+            do
+            {
+                last_node->next = old_head;
+            } while (!head.compare_exchange_weak(old_head, first_node,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed));
+        }
+
+        // Detach every pushed item; walk the result with next()
+        std::byte* takeAll()
+        {
+            if (!head.load(std::memory_order_relaxed))
+            {
+                return nullptr;
+            }
+            return reinterpret_cast<std::byte*>(head.exchange(nullptr, std::memory_order_acquire));
+        }
+
+        static std::byte* next(std::byte* item)
+        {
+            return reinterpret_cast<std::byte*>(reinterpret_cast<Node*>(item)->next);
+        }
+
+        static void setNext(std::byte* item, std::byte* next)
+        {
+            reinterpret_cast<Node*>(item)->next = reinterpret_cast<Node*>(next);
+        }
+
+        //
+        // The slab side of the protocol, shared by the locked engines. Each
+        // takes the slab's lock, a `validate` that runs every check that
+        // doesn't need the lock (throwing std::invalid_argument), and a
+        // `free_locked` that frees one item with the lock held. With
+        // `may_defer` false a contended free waits for the lock instead of
+        // being pushed.
+        //
+        template<Lockable Lock, typename Validate, typename FreeLocked>
+        void deallocate(Lock& lock, std::byte* item, Validate&& validate, FreeLocked&& free_locked,
+                        bool may_defer = true)
+        {
+            if (!item)
+            {
+                return;
+            }
+
+            std::unique_lock<Lock> guard(lock, std::defer_lock);
+            if (!may_defer)
+            {
+                guard.lock();
+            }
+            else if (!guard.try_lock())
+            {
+                // Contended: don't wait for the lock, leave the item for the
+                // holder to free. Everything but the double free check can be
+                // done here; that one needs the slot state, so it happens
+                // when the item is drained.
+                validate(item);
+                push(item);
+                return;
+            }
+            drain(free_locked);
+            free_locked(item);
+        }
+
+        template<Lockable Lock, typename Validate, typename FreeLocked>
+        void deallocateBatch(Lock& lock, std::span<std::byte* const> items, Validate&& validate,
+                             FreeLocked&& free_locked, bool may_defer = true)
+        {
+            // keep going past a bad item so one double free doesn't leak the
+            // rest of the batch; report the first failure once we're done
+            std::exception_ptr error;
+            auto each = [&](auto&& fn)
+            {
+                for (auto item : items)
+                {
+                    try
+                    {
+                        if (item)
+                        {
+                            fn(item);
+                        }
+                    }
+                    catch (const std::invalid_argument&)
+                    {
+                        if (!error)
+                        {
+                            error = std::current_exception();
+                        }
+                    }
+                }
+            };
+
+            std::unique_lock<Lock> guard(lock, std::defer_lock);
+            if (!may_defer)
+            {
+                guard.lock();
+            }
+            if (!guard.owns_lock() && !guard.try_lock())
+            {
+                // contended: chain the valid items and push them with one CAS
+                std::byte* first = nullptr;
+                std::byte* last = nullptr;
+                each([&](std::byte* item)
+                {
+                    validate(item);
+                    setNext(item, first);
+                    first = item;
+                    last = last ? last : item;
+                });
+                if (first)
+                {
+                    push(first, last);
+                }
+            }
+            else
+            {
+                drain(free_locked);
+                each(free_locked);
+            }
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+
+        // Free everything pushed so far; the caller holds the slab lock
+        template<typename FreeLocked>
+        void drain(FreeLocked&& free_locked)
+        {
+            std::byte* item = takeAll();
+            while (item)
+            {
+                // read the link before the slot is freed (and possibly
+                // reused; a free list keeps its own link in the same word)
+                std::byte* next_item = next(item);
+                try
+                {
+                    free_locked(item);
+                }
+                catch (const std::invalid_argument& e)
+                {
+                    // a double free that slipped past the lock-free checks;
+                    // the thread that caused it has long since returned
+                    debug_println("Dropped remote free of {}: {}", static_cast<void*>(item), e.what());
+                }
+                item = next_item;
+            }
+        }
+
+    private: // types
+        struct Node
+        {
+            Node* next;
+        };
+
+    private: // data members
+        std::atomic<Node*> head{nullptr};
+    };
+
+
+    //
+    // TrimPolicy controls what trim() gives back to the OS: only spans that
+    // have been empty for at least `decay` are released, and the first
+    // `hot_spans` empty spans of each slab are kept regardless, so a burst
+    // right after a trim doesn't fault its pages straight back in.
+    //
+    struct TrimPolicy
+    {
+        std::chrono::milliseconds decay{1000};
+        std::size_t hot_spans{1};
+    };
+
+
+    //
+    // SlabUsage is a point-in-time view of what a slab holds: its spans,
+    // how many of their slots are handed out (to callers or to a pool's
+    // caches), and the memory mapped for them. For SlabProxy a "span" and
+    // a "slot" are both a large block, live or cached.
+    //
+    struct SlabUsage
+    {
+        std::size_t spans{0};
+        std::size_t slots{0};
+        std::size_t used_slots{0};
+        std::size_t reserved_bytes{0};
+        std::size_t peak_reserved_bytes{0};
+    };
+
+
     class AbstractSlab
     {
     public: // methods
         virtual std::byte* allocateItem(std::size_t size) = 0;
         virtual void deallocateItem(std::byte* item) = 0;
 
+        // Allocate with the first `size` bytes zeroed. Slabs that know a
+        // slot has never been touched since it was mapped skip the clear.
+        virtual std::byte* allocateZeroedItem(std::size_t size)
+        {
+            std::byte* item = allocateItem(size);
+            std::memset(item, 0, size);
+            return item;
+        }
+
+        // Batch variants fill/drain many items per call; slabs that keep
+        // their own lock take it once for the whole batch. allocateBatch
+        // returns the number of items written to the front of `items`.
+        virtual std::size_t allocateBatch(std::size_t size, std::span<std::byte*> items) = 0;
+        virtual void deallocateBatch(std::span<std::byte* const> items) = 0;
+
+        // As allocateBatch(), but slots known to be untouched since their
+        // pages were mapped come back tagged with fresh_tag, so a cache
+        // holding them can still skip the clear for allocateZeroed().
+        // Slabs that don't track freshness tag nothing.
+        virtual std::size_t allocateTaggedBatch(std::size_t size, std::span<std::byte*> items)
+        {
+            return allocateBatch(size, items);
+        }
+
+        // Slots are at least 16-byte aligned, so the low bit of a slot
+        // pointer is free to carry the fresh mark
+        static constexpr std::uintptr_t fresh_tag{1};
+
+        static std::byte* tagFresh(std::byte* item, bool fresh)
+        {
+            return reinterpret_cast<std::byte*>(reinterpret_cast<std::uintptr_t>(item) | (fresh ? fresh_tag : 0));
+        }
+
+        // Strip the tag, reporting whether it was set
+        static std::byte* untag(std::byte* item, bool* fresh = nullptr)
+        {
+            auto bits = reinterpret_cast<std::uintptr_t>(item);
+            if (fresh)
+            {
+                *fresh = bits & fresh_tag;
+            }
+            return reinterpret_cast<std::byte*>(bits & ~fresh_tag);
+        }
+
+        // Release idle empty spans per `policy`; returns the bytes given
+        // back to the OS. Slabs with no spans to release keep the default.
+        virtual std::size_t trim(const TrimPolicy& /* policy */) { return 0; }
+
+        // Statistics of the slab's lock, if its lock type keeps any
+        virtual LockStatsSnapshot lockStats() const { return {}; }
+
+        // Spans, slots and memory currently held; locks the slab briefly
+        virtual SlabUsage usage() = 0;
+
         virtual ~AbstractSlab() = default;
 
     protected: // methods
@@ -81,20 +416,47 @@ namespace spallocator
     };
 
 
-    template<const std::size_t ElemSize>
+    template<const std::size_t ElemSize, Lockable Lock = SpinLock>
     class Slab: public AbstractSlab
     {
     public: // methods
         std::byte* allocateItem(std::size_t size);
         void deallocateItem(std::byte* item);
+        std::byte* allocateZeroedItem(std::size_t size);
+
+        std::size_t allocateBatch(std::size_t size, std::span<std::byte*> items);
+        std::size_t allocateTaggedBatch(std::size_t size, std::span<std::byte*> items);
+        void deallocateBatch(std::span<std::byte* const> items);
+
+        // Decommit the item pages of spans that have been empty for the
+        // decay window; the spans stay carved and are refaulted on reuse
+        std::size_t trim(const TrimPolicy& policy);
+
+        LockStatsSnapshot lockStats() const
+        {
+            if constexpr (requires { slab_lock.stats(); })
+            {
+                return slab_lock.stats();
+            }
+            return {};
+        }
+
+        SlabUsage usage();
 
         constexpr std::size_t getElemSize() const { return ElemSize; }
         constexpr std::size_t getAllocSize() const { return slab_alloc_size; }
-        std::size_t getAllocatedMemory() const { return slab_data.size() * slab_alloc_size; }
+        static constexpr std::size_t getItemsPerSlab() { return items_per_slab; }
+        std::size_t getAllocatedMemory() const;
+
+        // Bytes per span not available to items (header plus tail), and
+        // the fraction of the span that holds items
+        static constexpr std::size_t getWasteBytes() { return slab_alloc_size - items_per_slab * ElemSize; }
+        static constexpr double getOccupancy() { return double(items_per_slab * ElemSize) / slab_alloc_size; }
 
         std::optional<std::size_t> findSlabForItem(std::byte* item) const;
+        std::size_t getChunkCount() const { return chunks.size(); }
 
-        Slab();
+        explicit Slab(const PagePolicy& policy = {});
         virtual ~Slab();
 
     private: // methods
@@ -104,46 +466,142 @@ namespace spallocator
         Slab& operator=(Slab&&) = delete;
 
         void allocateNewSlab();
+        void allocateNewChunk();
+        void releaseEmptyChunks();
+        struct Span;
+        Span* findSpanForItem(std::byte* item) const;
+        static std::byte* itemsStart(Span* span)
+        {
+            return reinterpret_cast<std::byte*>(span) + data_offset;
+        }
+
+        // Find the span and slot index for an item, throwing
+        // std::invalid_argument if it can't be one of ours. Reads only
+        // immutable header fields, so it is safe without slab_lock.
+        std::pair<Span*, std::size_t> locateItem(std::byte* item) const;
+
+        // must be called with slab_lock held; `fresh` is set if the slot
+        // has never been written since its pages were mapped
+        std::byte* allocateItemLocked(bool* fresh = nullptr);
+        std::size_t allocateBatchImpl(std::size_t size, std::span<std::byte*> items, bool tag_fresh);
+        std::size_t allocateRunLocked(std::span<std::byte*> items, bool tag_fresh);
+        void deallocateItemLocked(std::byte* item);
+        void drainRemoteFrees();
     
     private: // data members
         static constexpr std::size_t slab_alloc_size{selectBufferSize<ElemSize>()};
-        static_assert(slab_alloc_size >= 4_KB, "Allocation size must be greater than 4096 bytes");
-        static_assert(
-            (ElemSize > 2_KB) || (slab_alloc_size % 1_KB == 0),
-            "Allocation size must be a multiple of 1024 when ElemSize <= 2KB");
+        static_assert(std::has_single_bit(slab_alloc_size) && slab_alloc_size >= min_span_size,
+            "Allocation size must be a power of two no smaller than min_span_size");
 
-        // subsequent allocations are a multiple of...
+        // Spans are carved out of chunks mapped by PageAllocator. Each
+        // chunk is alloc_multiplier times the previous one, up to
+        // max_chunk_size, so ramping up to N spans takes O(log N) system
+        // allocations.
         static constexpr std::size_t alloc_multiplier{2};
         static_assert(alloc_multiplier >= 2, "Allocation multiplier must be at least 2");
         static_assert(alloc_multiplier % 2 == 0, "Allocation multiplier must be a multiple of 2");
+        static constexpr std::size_t max_chunk_size{std::max(64_MB, slab_alloc_size)};
 
-        std::vector<std::byte*> slab_data;
-        // bitsets could be optimized more by creating custom bitset class
-        // with 64-bit chunks that can be compared atomically
-        std::vector<std::bitset<slab_alloc_size / ElemSize>> slab_map;
+        // Each slab is one span: the header below, then the items. The slot
+        // map is sized for a header-less span; the slots the header displaces
+        // are permanently marked allocated.
+        static constexpr std::size_t max_items{slab_alloc_size / ElemSize};
+        struct Span: SpanHeader
+        {
+            std::size_t chunk{0};   // index into chunks
+            std::chrono::steady_clock::time_point empty_since{};
+            bool decommitted{false};    // item pages given back by trim()
+            // slots from here up have never been handed out since their
+            // pages were mapped (or decommitted), so they read as zero
+            std::size_t fresh_from{0};
+            // one bit per slot, 1 = allocated; searched a 64-bit word at a time
+            Bitmap<max_items> slots;
+        };
+
+        static constexpr std::size_t data_offset{spanDataOffset(sizeof(Span), ElemSize)};
+        static constexpr std::size_t items_per_slab{(slab_alloc_size - data_offset) / ElemSize};
+        static_assert(items_per_slab >= 4, "Span must hold at least four items");
+        // slot bits permanently set because the header overlaps them
+        static constexpr std::size_t header_slots{max_items - items_per_slab};
+        static_assert(data_offset <= spanDataOffset(spanHeaderBound(max_items), ElemSize),
+            "Span header exceeds the bound selectBufferSize() sized the span for");
+
+        // Chunks are a stack: growth pushes, shrinking pops. A chunk is
+        // released once it and the one below it have no items in use, so
+        // memory is given back in the reverse order it was obtained and a
+        // workload oscillating around a chunk boundary doesn't thrash.
+        struct Chunk
+        {
+            std::byte* base{nullptr};
+            std::size_t span_count{0};  // capacity in spans
+            std::size_t carved{0};      // spans created so far
+            std::size_t used_spans{0};  // spans with at least one item in use
+        };
+        std::vector<Chunk> chunks;
+        // high-water mark of getAllocatedMemory()
+        std::size_t peak_reserved{0};
+        PagePolicy page_policy;
+
+        // spans are created on first use, so an idle slab owns no memory
+        std::vector<Span*> spans;
         static constexpr std::size_t max_slabs{4_GB / slab_alloc_size};
-        std::bitset<max_slabs> slab_available_map;
-
-        std::map<std::byte*, std::size_t> base_address_map;
-
-        SpinLock slab_lock;
+        // one bit per existing slab, 1 = has a free slot; grows with the
+        // slab count, and the summary level lets the search skip 4096 full
+        // slabs per word test
+        GrowableBitmap slab_available_map;
+
+        Lock slab_lock;
+        // frees that found slab_lock taken; drained by the next lock holder
+        RemoteFreeList remote_frees;
     };
 
 
     //
-    // SlabProxy does not manage its own memory; it delegates to
-    // standard memory allocation methods for large memory
-    // allocations that aren't suitable for small-memory slab
-    // optimizations
+    // SlabProxy handles allocations too large for the small slabs. Blocks
+    // below mmap_threshold are rounded up to page-granular classes and come
+    // from aligned operator new, with their capacity in a 16-byte prefix;
+    // freed ones are kept in a small per-class cache for the next request
+    // of that class. Larger blocks are mapped directly (honoring the pool's
+    // PagePolicy) with a SpanHeader in front, registered in the PageMap so
+    // they can be recognized and unmapped on free. Either way the block's
+    // size is known, so it can be reallocated.
     //
     class SlabProxy: public AbstractSlab
     {
     public: // methods
         std::byte* allocateItem(std::size_t size);
         void deallocateItem(std::byte* item);
+        // mapped blocks are fresh pages and are never touched
+        std::byte* allocateZeroedItem(std::size_t size);
 
-        SlabProxy() = default;
-        virtual ~SlabProxy() = default;
+        std::size_t allocateBatch(std::size_t size, std::span<std::byte*> items);
+        void deallocateBatch(std::span<std::byte* const> items);
+
+        // Large block aligned beyond 16 bytes (up to max_slot_alignment);
+        // the pool serves smaller over-aligned requests from page slots.
+        // Always mapped, since the free path can't tell which alignment an
+        // operator new block was allocated with
+        std::byte* allocateAligned(std::size_t size, std::size_t alignment);
+
+        // Bytes available at `item`: the class capacity for operator new
+        // blocks, the rest of the mapping for mapped ones
+        std::size_t usableSize(std::byte* item) const;
+
+        // Grow or shrink a mapped block, moving its pages instead of
+        // copying them where possible (see PageAllocator::remap()). Returns
+        // nullptr if `item` isn't a mapped block; the caller then copies.
+        std::byte* remapItem(std::byte* item, std::size_t size);
+
+        // Free cached blocks of classes with no free for at least
+        // `policy.decay`, keeping `policy.hot_spans` blocks of each
+        std::size_t trim(const TrimPolicy& policy);
+
+        SlabUsage usage();
+
+        explicit SlabProxy(const PagePolicy& policy = {}) : page_policy(policy) {}
+        virtual ~SlabProxy();
+
+        static constexpr std::size_t mmap_threshold{256_KB};
 
     private: // methods
         SlabProxy(const SlabProxy&) = delete;
@@ -151,235 +609,699 @@ namespace spallocator
         SlabProxy(SlabProxy&&) = delete;
         SlabProxy& operator=(SlabProxy&&) = delete;
 
+        std::byte* allocateMapped(std::size_t size, std::size_t data_offset);
+        void addReserved(std::size_t bytes);
+
     private: // data members
+        // mapped blocks start with a SpanHeader whose elem_size is the
+        // mapped size; the user pointer follows it
+        static constexpr std::size_t mapped_data_offset{spanDataOffset(sizeof(SpanHeader))};
+        // operator new blocks keep their capacity just before the user pointer
+        static constexpr std::size_t size_prefix{16};
+
+        // Operator new blocks, prefix included, are whole multiples of
+        // page_class_size. Each class caches up to cache_bytes_per_class
+        // of freed blocks (at least min_cached_blocks), linked through
+        // their first word, so a buffer that is repeatedly allocated and
+        // freed doesn't go back to the system allocator each time.
+        static constexpr std::size_t page_class_size{4_KB};
+        static constexpr std::size_t cache_bytes_per_class{256_KB};
+        static constexpr std::size_t min_cached_blocks{2};
+
+        static constexpr std::size_t pageClass(std::size_t size)
+        {
+            return (size + size_prefix - 1) / page_class_size;
+        }
+        static constexpr std::size_t classBytes(std::size_t page_class)
+        {
+            return (page_class + 1) * page_class_size;
+        }
+        static constexpr std::size_t cacheDepth(std::size_t page_class)
+        {
+            return std::max(min_cached_blocks, cache_bytes_per_class / classBytes(page_class));
+        }
+        // pageClass(mmap_threshold - 1) + 1; the class isn't complete yet
+        static constexpr std::size_t page_class_count{(mmap_threshold + size_prefix - 2) / page_class_size + 1};
+
+        struct BlockCache
+        {
+            SpinLock lock;
+            std::byte* head{nullptr};
+            std::size_t count{0};
+            // last free into this class; trim() only releases idle classes
+            std::chrono::steady_clock::time_point last_free{};
+        };
+        using BlockCaches = std::array<BlockCache, page_class_count>;
+        // created by the first free of an operator new block, so a pool
+        // that never frees one doesn't carry the table (about 2 KB)
+        std::atomic<BlockCaches*> block_cache{nullptr};
+
+        // blocks handed out, and bytes of every block held (live, cached
+        // or mapped); relaxed, since they are only read for usage()
+        std::atomic<std::size_t> live_blocks{0};
+        std::atomic<std::size_t> reserved{0};
+        std::atomic<std::size_t> peak_reserved{0};
+
+        // The block caches, creating them if needed; nullptr if they
+        // can't be allocated, in which case the block isn't cached
+        BlockCaches* blockCaches();
+
+        static std::byte*& nextBlock(std::byte* block)
+        {
+            return *reinterpret_cast<std::byte**>(block);
+        }
+        static void freeBlocks(std::byte* block)
+        {
+            while (block)
+            {
+                std::byte* next = nextBlock(block);
+                ::operator delete[](block, std::align_val_t{16});
+                block = next;
+            }
+        }
+
+        SpanHeader* findMapping(std::byte* item) const
+        {
+            SpanHeader* header = PageMap::instance().lookup(item);
+            return (header && header->owner == this) ? header : nullptr;
+        }
+
+        PagePolicy page_policy;
     };
 
 
-    // Helper for debug output
-    template<std::size_t N>
-    std::string printHex(const std::bitset<N>& bits)
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::byte* Slab<ElemSize, Lock>::allocateItem(std::size_t size)
+    {
+        runtime_assert(size <= ElemSize, [&] {
+            return std::format("Requested size {} exceeds slab element size {}", size, ElemSize);
+        });
+
+        std::scoped_lock<Lock> guard(slab_lock);
+        drainRemoteFrees();
+        return allocateItemLocked();
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::byte* Slab<ElemSize, Lock>::allocateZeroedItem(std::size_t size)
     {
-        std::string out;
+        runtime_assert(size <= ElemSize, [&] {
+            return std::format("Requested size {} exceeds slab element size {}", size, ElemSize);
+        });
 
-        // Process in 32-bit chunks from high to low
-        for (std::size_t chunk = (N + 31) / 32; chunk-- > 0; )
+        bool fresh = false;
+        std::byte* item = nullptr;
         {
-            std::size_t start = chunk * 32;
-            std::size_t end = std::min(start + 32, N);
+            std::scoped_lock<Lock> guard(slab_lock);
+            drainRemoteFrees();
+            item = allocateItemLocked(&fresh);
+        }
+        // clear outside the lock; memset already uses the widest vector
+        // stores the CPU has
+        if (!fresh)
+        {
+            std::memset(item, 0, size);
+        }
+        return item;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t Slab<ElemSize, Lock>::allocateBatch(std::size_t size, std::span<std::byte*> items)
+    {
+        return allocateBatchImpl(size, items, false);
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t Slab<ElemSize, Lock>::allocateTaggedBatch(std::size_t size, std::span<std::byte*> items)
+    {
+        return allocateBatchImpl(size, items, true);
+    }
 
-            // Extract 32-bit value
-            uint32_t value = 0;
-            for (std::size_t i = start; i < end; ++i)
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t Slab<ElemSize, Lock>::allocateBatchImpl(std::size_t size, std::span<std::byte*> items, bool tag_fresh)
+    {
+        runtime_assert(size <= ElemSize, [&] {
+            return std::format("Requested size {} exceeds slab element size {}", size, ElemSize);
+        });
+
+        std::scoped_lock<Lock> guard(slab_lock);
+        drainRemoteFrees();
+        std::size_t count = 0;
+        try
+        {
+            while (count < items.size())
             {
-                if (bits[i])
-                {
-                    value |= (1U << (i - start));
-                }
+                count += allocateRunLocked(items.subspan(count), tag_fresh);
             }
-
-            // Print with separator
-            if (chunk < (N + 31) / 32 - 1)
+        }
+        catch (const std::out_of_range&)
+        {
+            // exhausted part way through; hand back what we did get
+            if (count == 0)
             {
-                out += " ";
+                throw;
             }
-            out += std::format("{:08X}", value);
         }
-        return out;
+        return count;
     }
 
 
-    template<const std::size_t ElemSize>
-    std::byte* Slab<ElemSize>::allocateItem(std::size_t size)
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t Slab<ElemSize, Lock>::allocateRunLocked(std::span<std::byte*> items, bool tag_fresh)
     {
-        runtime_assert(size <= ElemSize,
-            std::format("Requested size {} exceeds slab element size {}", size, ElemSize));
+        // Fill as much of `items` as one span allows, claiming free slots a
+        // 64-bit word at a time instead of searching for each one
+        auto slab_index = slab_available_map.findFirstSet();
+        if (slab_index == slab_available_map.npos)
+        {
+            allocateNewSlab();
+            slab_index = spans.size() - 1;
+        }
 
-        std::scoped_lock<SpinLock> guard(slab_lock);
+        Span* span = spans[slab_index];
+        auto& slab_slots = span->slots;
+        if (slab_slots.count() == header_slots)
+        {
+            ++chunks[span->chunk].used_spans;
+            span->decommitted = false;
+        }
 
-        // Find a free item in the slabs
-        for (std::size_t slab_index = 0; slab_index <= slab_map.size(); ++slab_index)
+        std::size_t count = 0;
+        std::byte* items_start = itemsStart(span);
+        for (std::size_t w = slab_slots.findFirstClear() / slab_slots.bits_per_word;
+             w < slab_slots.word_count && count < items.size(); ++w)
         {
-            if (!slab_available_map.test(slab_index))
+            uint64_t claimed = slab_slots.claimWord(w, items.size() - count);
+            while (claimed)
             {
-                // this slab is full
-                continue;
+                std::size_t item_index = w * slab_slots.bits_per_word + std::countr_zero(claimed);
+                bool fresh = tag_fresh && PageAllocator::maps_zeroed && item_index >= span->fresh_from;
+                items[count++] = tagFresh(items_start + item_index * ElemSize, fresh);
+                span->fresh_from = std::max(span->fresh_from, item_index + 1);
+                claimed &= claimed - 1;
             }
+        }
+        if (slab_slots.all())
+        {
+            slab_available_map.reset(slab_index);
+        }
+        debug_println("Batch allocated {} items from slab<{}> span {}", count, ElemSize, slab_index);
+        return count;
+    }
 
-            while (slab_index >= slab_data.size())
-            {
-                // need to allocate a new slab
-                allocateNewSlab();
-                debug_println("New slab<{}> allocated, total slabs: {}/{}",
-                              ElemSize, slab_data.size(), slab_map.size());
-            }
 
-            auto& slab_slots = slab_map[slab_index];
-            for (std::size_t item_index = 0; item_index < slab_slots.size(); ++item_index)
-            {
-                if (!slab_slots.test(item_index))
-                {
-                    // Found a free item
-                    slab_slots.set(item_index);
-                    if (slab_slots.all())
-                    {
-                        // this slab is now full
-                        slab_available_map.reset(slab_index);
-                    }
-                    debug_println("Item allocated ({}/{}), slab_map<{}>: {}",
-                                  slab_index, item_index, ElemSize, printHex(slab_slots));
-                    return slab_data[slab_index] + item_index * ElemSize;
-                }
-            }
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::byte* Slab<ElemSize, Lock>::allocateItemLocked(bool* fresh /* = nullptr */)
+    {
+        // Find a slab with a free item
+        auto slab_index = slab_available_map.findFirstSet();
+        if (slab_index == slab_available_map.npos)
+        {
+            // every existing slab is full (or none exist yet); throws
+            // std::out_of_range once max_slabs is reached
+            allocateNewSlab();
+            slab_index = spans.size() - 1;
+            debug_println("New slab<{}> allocated, total slabs: {}", ElemSize, spans.size());
         }
 
-        throw std::out_of_range(std::format("Memory for {}-byte slab has been exhausted", ElemSize));
+        Span* span = spans[slab_index];
+        auto& slab_slots = span->slots;
+        auto item_index = slab_slots.findFirstClear();
+        runtime_assert(item_index != slab_slots.npos, [&] {
+            return std::format("Slab {} is marked available but has no free slot", slab_index);
+        });
+
+        if (slab_slots.count() == header_slots)
+        {
+            // first item in use in this span
+            ++chunks[span->chunk].used_spans;
+            span->decommitted = false;
+        }
+        slab_slots.set(item_index);
+        if (fresh)
+        {
+            *fresh = PageAllocator::maps_zeroed && item_index >= span->fresh_from;
+        }
+        span->fresh_from = std::max(span->fresh_from, item_index + 1);
+        if (slab_slots.all())
+        {
+            // this slab is now full
+            slab_available_map.reset(slab_index);
+        }
+        if constexpr (VERBOSE_DEBUG)
+        {
+            debug_println("Item allocated ({}/{}), slab_map<{}>: {}",
+                          slab_index, item_index, ElemSize, printHex(slab_slots));
+        }
+        return itemsStart(span) + item_index * ElemSize;
     }
 
 
-    template<const std::size_t ElemSize>
-    std::optional<std::size_t> Slab<ElemSize>::findSlabForItem(std::byte* item) const
+    template<const std::size_t ElemSize, Lockable Lock>
+    typename Slab<ElemSize, Lock>::Span* Slab<ElemSize, Lock>::findSpanForItem(std::byte* item) const
     {
-        auto it = base_address_map.upper_bound(item);
-        if (it != base_address_map.begin())
+        // The span header sits at the span's aligned base; the page map
+        // confirms that base is a live span before we read the header, so
+        // a pointer that never came from a slab is rejected safely
+        auto base = reinterpret_cast<std::byte*>(
+            reinterpret_cast<std::uintptr_t>(item) & ~(slab_alloc_size - 1));
+        SpanHeader* header = PageMap::instance().lookup(base);
+        if (reinterpret_cast<std::byte*>(header) != base || header->owner != this)
         {
-            --it;
-            auto slab_start = it->first;
-            auto slab_end = slab_start + slab_alloc_size;
-            if (item >= slab_start && item < slab_end)
-            {
-                return it->second;
-            }
-            else
-            {
-                // given the pointer base ranges, it should be here, but it turns
-                // out not to be within the begin-end range
-                runtime_assert(item >= slab_start && item < slab_end,
-                    std::format("Item {} cannot be found in slab range {} - {}",
-                                static_cast<void*>(item),
-                                static_cast<void*>(slab_start),
-                                static_cast<void*>(slab_end)));
-            }
+            return nullptr;
         }
-        return std::nullopt;
+        return static_cast<Span*>(header);
     }
 
 
-    template<const std::size_t ElemSize>
-    void Slab<ElemSize>::deallocateItem(std::byte* item)
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::optional<std::size_t> Slab<ElemSize, Lock>::findSlabForItem(std::byte* item) const
     {
-        if (!item)
+        if (Span* span = findSpanForItem(item))
         {
-            return;
+            return span->index;
         }
+        return std::nullopt;
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void Slab<ElemSize, Lock>::deallocateItem(std::byte* item)
+    {
+        remote_frees.deallocate(slab_lock, item,
+                                [this](std::byte* item) { locateItem(item); },
+                                [this](std::byte* item) { deallocateItemLocked(item); });
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void Slab<ElemSize, Lock>::deallocateBatch(std::span<std::byte* const> items)
+    {
+        remote_frees.deallocateBatch(slab_lock, items,
+                                     [this](std::byte* item) { locateItem(item); },
+                                     [this](std::byte* item) { deallocateItemLocked(item); });
+    }
 
-        std::scoped_lock<SpinLock> guard(slab_lock);
 
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::pair<typename Slab<ElemSize, Lock>::Span*, std::size_t> Slab<ElemSize, Lock>::locateItem(std::byte* item) const
+    {
         // Find which slab this item belongs to
-        if (auto slab_index_opt = findSlabForItem(item); !slab_index_opt.has_value())
+        Span* span = findSpanForItem(item);
+        if (!span)
         {
             throw std::invalid_argument("Invalid item pointer; no corresponding slab found");
         }
-        else
+
+        // Calculate the item index within the slab
+        auto offset = item - itemsStart(span);
+        if (offset < 0 || offset % ElemSize != 0 || static_cast<std::size_t>(offset) / ElemSize >= items_per_slab)
+        {
+            throw std::invalid_argument("Invalid item pointer; item not found in slab");
+        }
+        return {span, offset / ElemSize};
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void Slab<ElemSize, Lock>::drainRemoteFrees()
+    {
+        remote_frees.drain([this](std::byte* item) { deallocateItemLocked(item); });
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void Slab<ElemSize, Lock>::deallocateItemLocked(std::byte* item)
+    {
+        auto [span, item_index] = locateItem(item);
+        auto& slab_slots = span->slots;
+        if (!slab_slots.test(item_index))
+        {
+            throw std::invalid_argument("Item is already free");
+        }
+
+        // Free the item
+        slab_slots.reset(item_index);
+        // This slab now has free space
+        slab_available_map.set(span->index);
+        if constexpr (VERBOSE_DEBUG)
         {
-            auto slab_index = *slab_index_opt;
+            debug_println("Item freed ({}/{}), slab_map: {}",
+                          span->index, item_index, printHex(slab_slots));
+        }
+
+        if (slab_slots.count() == header_slots)
+        {
+            // last item in use in this span
+            span->empty_since = std::chrono::steady_clock::now();
+            if (--chunks[span->chunk].used_spans == 0)
+            {
+                releaseEmptyChunks();
+            }
+        }
+    }
 
-            auto slab_start = slab_data[slab_index];
-            //auto slab_end = slab_start + slab_alloc_size;
 
-            // Calculate the item index within the slab
-            std::size_t item_index = (item - slab_start) / ElemSize;
-            auto& slab_slots = slab_map[slab_index];
-            if (slab_slots.test(item_index))
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t Slab<ElemSize, Lock>::trim(const TrimPolicy& policy)
+    {
+        // the header stays resident (the page map and slot bitmap live in
+        // it); everything from the first page boundary past it is released
+        static constexpr std::size_t page_size{4_KB};
+        static constexpr std::size_t decommit_offset{(data_offset + page_size - 1) & ~(page_size - 1)};
+
+        auto now = std::chrono::steady_clock::now();
+        std::size_t released = 0;
+        std::size_t hot = 0;
+
+        std::scoped_lock<Lock> guard(slab_lock);
+        drainRemoteFrees();
+        // allocation takes the lowest-indexed span with room, so the hot
+        // reserve is the lowest empty spans
+        for (auto span : spans)
+        {
+            if (span->decommitted || span->slots.count() != header_slots)
             {
-                // Free the item
-                slab_slots.reset(item_index);
-                // This slab now has free space
-                slab_available_map.set(slab_index);
-                debug_println("Item freed ({}/{}), slab_map: {}",
-                              slab_index, item_index, printHex(slab_slots));
-                return;
+                continue;
             }
-            else
+            if (hot < policy.hot_spans)
             {
-                throw std::invalid_argument("Item is already free");
+                ++hot;
+                continue;
+            }
+            if (now - span->empty_since < policy.decay)
+            {
+                continue;
             }
+            std::size_t bytes = PageAllocator::decommit(reinterpret_cast<std::byte*>(span) + decommit_offset,
+                                                        slab_alloc_size - decommit_offset, page_policy);
+            if (bytes > 0)
+            {
+                // every slot wholly inside the decommitted pages reads as
+                // zero again
+                span->fresh_from = (decommit_offset - data_offset + ElemSize - 1) / ElemSize;
+            }
+            released += bytes;
+            span->decommitted = true;
         }
+        debug_println("Trimmed {} bytes from slab<{}>", released, ElemSize);
+        return released;
+    }
 
-        throw std::invalid_argument("Invalid item pointer; item not found in slab");
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    SlabUsage Slab<ElemSize, Lock>::usage()
+    {
+        std::scoped_lock<Lock> guard(slab_lock);
+        drainRemoteFrees();
+        SlabUsage result;
+        result.spans = spans.size();
+        result.slots = spans.size() * items_per_slab;
+        for (auto span : spans)
+        {
+            result.used_slots += span->slots.count() - header_slots;
+        }
+        result.reserved_bytes = getAllocatedMemory();
+        result.peak_reserved_bytes = peak_reserved;
+        return result;
     }
 
 
-    template<const std::size_t ElemSize>
-    Slab<ElemSize>::Slab()
+    template<const std::size_t ElemSize, Lockable Lock>
+    Slab<ElemSize, Lock>::Slab(const PagePolicy& policy)
+        : page_policy(policy)
     {
         debug_println("Slab created with element size: {}, allocation size: {}, and multiplier: {}",
                       getElemSize(), getAllocSize(), alloc_multiplier);
 
-        // all slabs are initially available
-        slab_available_map.set();
-
-        allocateNewSlab();
+        // the first span is created by the first allocation
     }
 
-    template<const std::size_t ElemSize>
-    Slab<ElemSize>::~Slab()
+    template<const std::size_t ElemSize, Lockable Lock>
+    Slab<ElemSize, Lock>::~Slab()
     {
         debug_println("Slab destroyed, freeing {} bytes of memory", getAllocatedMemory());
-        for (auto ptr : slab_data)
+        for (auto span : spans)
+        {
+            PageMap::instance().clear(reinterpret_cast<std::byte*>(span), slab_alloc_size);
+            span->~Span();
+        }
+        for (auto& chunk : chunks)
         {
-            // C++23 is improved to handle aligned deallocation automatically.
-            // For earlier standards, we need to explicitly pass the alignment
-            // to the delete operator. Unfortunately, this is incomplete in
-            // gcc-14's implementation of the address sanitizer in spite of
-            // otherwise decent C++23 support, so we need to use the older C++17
-            // style deallocation here for portability
-            ::operator delete[](ptr, std::align_val_t{16});  // Explicitly pass alignment
+            PageAllocator::unmap(chunk.base, chunk.span_count * slab_alloc_size, page_policy);
+        }
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    std::size_t Slab<ElemSize, Lock>::getAllocatedMemory() const
+    {
+        std::size_t total = 0;
+        for (auto& chunk : chunks)
+        {
+            total += chunk.span_count * slab_alloc_size;
+        }
+        return total;
+    }
+
 
-            // Preferred C++23 form that we are avoiding for now due to above issues:
-            //delete[] ptr;
+    template<const std::size_t ElemSize, Lockable Lock>
+    void Slab<ElemSize, Lock>::allocateNewChunk()
+    {
+        // chunk k holds alloc_multiplier^k spans, capped at max_chunk_size
+        // and at the spans left before max_slabs
+        std::size_t span_count = 1;
+        for (std::size_t k = 0; k < chunks.size() && span_count * slab_alloc_size < max_chunk_size; ++k)
+        {
+            span_count *= alloc_multiplier;
         }
+        std::size_t alignment = slab_alloc_size;
+        if (page_policy.huge_pages != HugePages::off)
+        {
+            // a huge page can only back a whole, aligned huge page of chunk
+            span_count = std::max(span_count, PageAllocator::huge_page_size / slab_alloc_size);
+            alignment = std::max(alignment, PageAllocator::huge_page_size);
+        }
+        span_count = std::min({span_count, max_chunk_size / slab_alloc_size, max_slabs - spans.size()});
+
+        chunks.reserve(chunks.size() + 1);
+        Chunk chunk;
+        chunk.span_count = span_count;
+        chunk.base = PageAllocator::map(span_count * slab_alloc_size, alignment, page_policy);
+        chunks.push_back(chunk);
+        peak_reserved = std::max(peak_reserved, getAllocatedMemory());
+        debug_println("New chunk for slab<{}>: {} spans, total chunks: {}", ElemSize, span_count, chunks.size());
     }
 
-    template<const std::size_t ElemSize>
-    void Slab<ElemSize>::allocateNewSlab()
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void Slab<ElemSize, Lock>::allocateNewSlab()
     {
-        if (slab_data.size() >= max_slabs)
+        if (spans.size() >= max_slabs)
         {
             throw std::out_of_range(
-                std::format("Cannot allocate more than {} slabs of size {} bytes",
-                            max_slabs, slab_alloc_size));
+                std::format("Memory for {}-byte slab has been exhausted ({} slabs of {} bytes)",
+                            ElemSize, max_slabs, slab_alloc_size));
         }
 
         static_assert(ElemSize >= 16,
             "Element size must be at least 16 bytes");
         static_assert(ElemSize % 16 == 0,
             "Element size must be a multiple of 16 bytes");
-    
-        // allocate a new slab of memory
-        std::byte* new_slab = new(std::align_val_t{16}) std::byte[slab_alloc_size];
-        slab_data.push_back(new_slab);
-        base_address_map[new_slab] = slab_data.size() - 1;
-        slab_map.emplace_back();
+
+        spans.reserve(spans.size() + 1);
+        slab_available_map.resize(spans.size() + 1);
+        if (chunks.empty() || chunks.back().carved == chunks.back().span_count)
+        {
+            allocateNewChunk();
+        }
+
+        // carve the next span out of the newest chunk; chunks are aligned
+        // to the span size, so every span in them is too
+        Chunk& chunk = chunks.back();
+        std::byte* new_slab = chunk.base + chunk.carved * slab_alloc_size;
+        Span* span = new(new_slab) Span{};
+        span->owner = this;
+        span->index = spans.size();
+        span->elem_size = ElemSize;
+        span->chunk = chunks.size() - 1;
+        for (std::size_t i = items_per_slab; i < max_items; ++i)
+        {
+            // slots overlapped by the header are never handed out
+            span->slots.set(i);
+        }
+
+        PageMap::instance().set(new_slab, slab_alloc_size, span);
+        ++chunk.carved;
+        spans.push_back(span);
+        slab_available_map.set(span->index);
+    }
+
+
+    template<const std::size_t ElemSize, Lockable Lock>
+    void Slab<ElemSize, Lock>::releaseEmptyChunks()
+    {
+        // Pop the newest chunk while both it and the chunk below are empty;
+        // the lower one stays as a reserve. Spans in the newest chunk have
+        // the highest indices, so popping them keeps the span list dense.
+        while (chunks.size() >= 2 &&
+               chunks.back().used_spans == 0 &&
+               chunks[chunks.size() - 2].used_spans == 0)
+        {
+            Chunk& chunk = chunks.back();
+            for (std::size_t i = 0; i < chunk.carved; ++i)
+            {
+                Span* span = spans.back();
+                PageMap::instance().clear(reinterpret_cast<std::byte*>(span), slab_alloc_size);
+                span->~Span();
+                spans.pop_back();
+            }
+            slab_available_map.resize(spans.size());
+
+            PageAllocator::unmap(chunk.base, chunk.span_count * slab_alloc_size, page_policy);
+            debug_println("Released chunk of {} spans for slab<{}>, total chunks: {}",
+                          chunk.span_count, ElemSize, chunks.size() - 1);
+            chunks.pop_back();
+        }
     }
 
 
     inline std::byte* SlabProxy::allocateItem(std::size_t elem_size)
     {
-        runtime_assert(elem_size > 1_KB,
-            std::format("SlabProxy should only be used for large allocations, got {}", elem_size));
-        runtime_assert(elem_size <= 1_GB,
-            std::format("Requested size {} exceeds maximum allowed size for SlabProxy", elem_size));
+        runtime_assert(elem_size <= 1_GB, [&] {
+            return std::format("Requested size {} exceeds maximum allowed size for SlabProxy", elem_size);
+        });
 
-        // allocate memory using standard methods
-        std::byte* item = new(std::align_val_t{16}) std::byte[elem_size];
+        if (elem_size >= mmap_threshold)
+        {
+            return allocateMapped(elem_size, mapped_data_offset);
+        }
+
+        // reuse a cached block of the same class, else allocate one using
+        // standard methods
+        std::size_t page_class = pageClass(elem_size);
+        std::byte* block = nullptr;
+        if (BlockCaches* caches = block_cache.load(std::memory_order_acquire))
+        {
+            BlockCache& cache = (*caches)[page_class];
+            std::scoped_lock<SpinLock> guard(cache.lock);
+            if (cache.head)
+            {
+                block = cache.head;
+                cache.head = nextBlock(block);
+                --cache.count;
+            }
+        }
+        if (!block)
+        {
+            block = new(std::align_val_t{16}) std::byte[classBytes(page_class)];
+            addReserved(classBytes(page_class));
+        }
+        live_blocks.fetch_add(1, std::memory_order_relaxed);
+        *reinterpret_cast<std::size_t*>(block) = classBytes(page_class) - size_prefix;
+        std::byte* item = block + size_prefix;
         debug_println("Allocated {} bytes via SlabProxy, ptr={}",
                       elem_size, static_cast<void*>(item));
         return item;
     }
 
 
+    inline std::byte* SlabProxy::allocateZeroedItem(std::size_t size)
+    {
+        std::byte* item = allocateItem(size);
+        if (size < mmap_threshold || !PageAllocator::maps_zeroed)
+        {
+            std::memset(item, 0, size);
+        }
+        return item;
+    }
+
+
+    inline std::byte* SlabProxy::allocateAligned(std::size_t size, std::size_t alignment)
+    {
+        runtime_assert(size <= 1_GB, [&] {
+            return std::format("Requested size {} exceeds maximum allowed size for SlabProxy", size);
+        });
+        runtime_assert(std::has_single_bit(alignment) && alignment <= max_slot_alignment, [&] {
+            return std::format("Unsupported SlabProxy alignment {}", alignment);
+        });
+
+        // the mapping is min_span_size aligned, so an offset that is a
+        // multiple of the alignment gives an aligned user pointer
+        return allocateMapped(size, std::max(mapped_data_offset, alignment));
+    }
+
+
+    inline std::byte* SlabProxy::allocateMapped(std::size_t size, std::size_t data_offset)
+    {
+        // map whole page-map granules so the block can be registered
+        std::size_t mapped_size = (data_offset + size + min_span_size - 1) & ~(min_span_size - 1);
+        std::byte* base = PageAllocator::map(mapped_size, min_span_size, page_policy);
+        auto header = new(base) SpanHeader{};
+        header->owner = this;
+        header->elem_size = mapped_size;
+        try
+        {
+            PageMap::instance().set(base, mapped_size, header);
+        }
+        catch (...)
+        {
+            PageAllocator::unmap(base, mapped_size, page_policy);
+            throw;
+        }
+        addReserved(mapped_size);
+        live_blocks.fetch_add(1, std::memory_order_relaxed);
+        debug_println("Mapped {} bytes via SlabProxy, ptr={}", mapped_size, static_cast<void*>(base));
+        return base + data_offset;
+    }
+
+
     inline void SlabProxy::deallocateItem(std::byte* item)
     {
+        if (!item)
+        {
+            return;
+        }
+
+        if (SpanHeader* header = findMapping(item))
+        {
+            auto base = reinterpret_cast<std::byte*>(header);
+            std::size_t mapped_size = header->elem_size;
+            debug_println("Unmapped {} bytes via SlabProxy, ptr={}", mapped_size, static_cast<void*>(base));
+            PageMap::instance().clear(base, mapped_size);
+            PageAllocator::unmap(base, mapped_size, page_policy);
+            reserved.fetch_sub(mapped_size, std::memory_order_relaxed);
+            live_blocks.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+
+        std::byte* block = item - size_prefix;
+        std::size_t page_class = pageClass(*reinterpret_cast<std::size_t*>(block));
+        runtime_assert(page_class < page_class_count &&
+                       classBytes(page_class) == *reinterpret_cast<std::size_t*>(block) + size_prefix,
+            "Item is not a SlabProxy block (corrupted size prefix?)");
+        live_blocks.fetch_sub(1, std::memory_order_relaxed);
+
+        // keep it for the next request of its class while there's room
+        if (BlockCaches* caches = blockCaches())
+        {
+            BlockCache& cache = (*caches)[page_class];
+            auto now = std::chrono::steady_clock::now();
+            std::scoped_lock<SpinLock> guard(cache.lock);
+            if (cache.count < cacheDepth(page_class))
+            {
+                nextBlock(block) = cache.head;
+                cache.head = block;
+                ++cache.count;
+                cache.last_free = now;
+                return;
+            }
+        }
+
         // deallocate memory using standard methods
         debug_println("Deallocated item via SlabProxy, ptr={}", static_cast<void*>(item));
 
@@ -389,13 +1311,214 @@ namespace spallocator
         // gcc-14's implementation of the address sanitizer in spite of
         // otherwise decent C++23 support, so we need to use the older C++17
         // style deallocation here for portability
-        ::operator delete[](item, std::align_val_t{16});  // Explicitly pass alignment
+        ::operator delete[](block, std::align_val_t{16});  // Explicitly pass alignment
+        reserved.fetch_sub(classBytes(page_class), std::memory_order_relaxed);
 
         // Preferred C++23 form that we are avoiding for now due to above issues:
         //delete[] item;
     }
 
 
+    inline std::size_t SlabProxy::usableSize(std::byte* item) const
+    {
+        if (SpanHeader* header = findMapping(item))
+        {
+            return header->elem_size - (item - reinterpret_cast<std::byte*>(header));
+        }
+        return *reinterpret_cast<std::size_t*>(item - size_prefix);
+    }
+
+
+    inline std::byte* SlabProxy::remapItem(std::byte* item, std::size_t size)
+    {
+        SpanHeader* header = findMapping(item);
+        if (!header)
+        {
+            return nullptr;
+        }
+
+        auto base = reinterpret_cast<std::byte*>(header);
+        std::size_t data_offset = item - base;
+        std::size_t old_size = header->elem_size;
+        std::size_t new_size = (data_offset + size + min_span_size - 1) & ~(min_span_size - 1);
+        if (new_size == old_size)
+        {
+            return item;
+        }
+
+        // the page map entries for the old range go first: a moved mapping
+        // leaves them dangling, and a shrunk one leaves its tail unmapped
+        PageMap::instance().clear(base, old_size);
+        std::byte* new_base = nullptr;
+        try
+        {
+            new_base = PageAllocator::remap(base, old_size, new_size, min_span_size, page_policy);
+        }
+        catch (...)
+        {
+            // the old mapping is untouched on failure
+            PageMap::instance().set(base, old_size, header);
+            throw;
+        }
+
+        header = reinterpret_cast<SpanHeader*>(new_base);
+        header->elem_size = new_size;
+        PageMap::instance().set(new_base, new_size, header);
+        if (new_size > old_size)
+        {
+            addReserved(new_size - old_size);
+        }
+        else
+        {
+            reserved.fetch_sub(old_size - new_size, std::memory_order_relaxed);
+        }
+        debug_println("Remapped {} -> {} bytes via SlabProxy, ptr={}", old_size, new_size, static_cast<void*>(new_base));
+        return new_base + data_offset;
+    }
+
+
+    inline std::size_t SlabProxy::trim(const TrimPolicy& policy)
+    {
+        BlockCaches* caches = block_cache.load(std::memory_order_acquire);
+        if (!caches)
+        {
+            return 0;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        std::size_t released = 0;
+        for (std::size_t page_class = 0; page_class < page_class_count; ++page_class)
+        {
+            BlockCache& cache = (*caches)[page_class];
+            std::byte* victims = nullptr;
+            {
+                std::scoped_lock<SpinLock> guard(cache.lock);
+                if (cache.count <= policy.hot_spans || now - cache.last_free < policy.decay)
+                {
+                    continue;
+                }
+                // detach everything past the hot blocks; free it unlocked
+                std::byte** link = &cache.head;
+                for (std::size_t i = 0; i < policy.hot_spans; ++i)
+                {
+                    link = &nextBlock(*link);
+                }
+                victims = *link;
+                *link = nullptr;
+                released += (cache.count - policy.hot_spans) * classBytes(page_class);
+                cache.count = policy.hot_spans;
+            }
+            freeBlocks(victims);
+        }
+        reserved.fetch_sub(released, std::memory_order_relaxed);
+        debug_println("Trimmed {} bytes of cached blocks from SlabProxy", released);
+        return released;
+    }
+
+
+    inline SlabUsage SlabProxy::usage()
+    {
+        std::size_t cached = 0;
+        if (BlockCaches* caches = block_cache.load(std::memory_order_acquire))
+        {
+            for (auto& cache : *caches)
+            {
+                std::scoped_lock<SpinLock> guard(cache.lock);
+                cached += cache.count;
+            }
+        }
+        SlabUsage result;
+        result.used_slots = live_blocks.load(std::memory_order_relaxed);
+        result.spans = result.used_slots + cached;
+        result.slots = result.spans;
+        result.reserved_bytes = reserved.load(std::memory_order_relaxed);
+        result.peak_reserved_bytes = peak_reserved.load(std::memory_order_relaxed);
+        return result;
+    }
+
+
+    inline void SlabProxy::addReserved(std::size_t bytes)
+    {
+        std::size_t total = reserved.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        std::size_t peak = peak_reserved.load(std::memory_order_relaxed);
+        while (total > peak && !peak_reserved.compare_exchange_weak(peak, total, std::memory_order_relaxed))
+        {
+        }
+    }
+
+
+    inline SlabProxy::BlockCaches* SlabProxy::blockCaches()
+    {
+        BlockCaches* caches = block_cache.load(std::memory_order_acquire);
+        if (caches)
+        {
+            return caches;
+        }
+
+        // a free must not throw, so fall back to not caching
+        auto created = new(std::nothrow) BlockCaches{};
+        if (!created)
+        {
+            return nullptr;
+        }
+        if (block_cache.compare_exchange_strong(caches, created, std::memory_order_acq_rel,
+                                                std::memory_order_acquire))
+        {
+            return created;
+        }
+        // another thread got there first; `caches` is now theirs
+        delete created;
+        return caches;
+    }
+
+
+    inline SlabProxy::~SlabProxy()
+    {
+        BlockCaches* caches = block_cache.load(std::memory_order_acquire);
+        if (caches)
+        {
+            for (auto& cache : *caches)
+            {
+                freeBlocks(cache.head);
+            }
+            delete caches;
+        }
+    }
+
+
+    inline std::size_t SlabProxy::allocateBatch(std::size_t size, std::span<std::byte*> items)
+    {
+        // large allocations have no shared state to amortize; this only
+        // exists to satisfy the AbstractSlab interface
+        std::size_t count = 0;
+        try
+        {
+            for (; count < items.size(); ++count)
+            {
+                items[count] = allocateItem(size);
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            // like the slabs, hand back a short batch; the next call throws
+            if (count == 0)
+            {
+                throw;
+            }
+        }
+        return count;
+    }
+
+
+    inline void SlabProxy::deallocateBatch(std::span<std::byte* const> items)
+    {
+        for (auto item : items)
+        {
+            deallocateItem(item);
+        }
+    }
+
+
 }; // namespace spallocator
 
 
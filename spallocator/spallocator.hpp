@@ -46,30 +46,37 @@
 
 namespace spallocator
 {
-    // Custom deleter for unique_ptr that uses Pool::deallocate
-    template<typename T>
+    // Custom deleter for unique_ptr that uses Pool::deallocate. PoolType is
+    // any BasicPool instantiation; Pool (the default size classes) if omitted.
+    template<typename T, typename PoolType = Pool>
     struct PoolDeleter
     {
-        spallocator::Pool& pool;
+        PoolType& pool;
 
         void operator()(T* p) const
         {
             if (p)
             {
                 p->~T();  // Explicitly call destructor since we use placement new
-                pool.deallocate(reinterpret_cast<std::byte*>(p));
+                pool.deallocate(reinterpret_cast<std::byte*>(p), sizeof(T), alignof(T));
             }
         }
     };
 
     // Specialization for array types
-    template<typename T>
-    struct PoolDeleter<T[]>
+    template<typename T, typename PoolType>
+    struct PoolDeleter<T[], PoolType>
     {
-        spallocator::Pool& pool;
+        PoolType& pool;
 
         const std::size_t size;
 
+        // must match make_pool_unique<T[]>
+        static constexpr std::size_t arrayAlignment()
+        {
+            return alignof(T) > alignof(std::size_t) ? alignof(T) : alignof(std::size_t);
+        }
+
         void operator()(T* p) const  // Note: T*, not T*[]
         {
             if (p)
@@ -77,35 +84,34 @@ namespace spallocator
                 // Call destructors in reverse order
                 std::ranges::for_each(std::views::counted(p, size) | std::views::reverse,
                                       [](T& elem){ elem.~T(); });
-                pool.deallocate(reinterpret_cast<std::byte*>(p));
+                pool.deallocate(reinterpret_cast<std::byte*>(p), sizeof(T) * size, arrayAlignment());
             }
         }
     };
 
     // Type alias for unique_ptr with pool-based deallocation
-    template<typename T>
-    using unique_pool_ptr = std::unique_ptr<T, PoolDeleter<T>>;
+    template<typename T, typename PoolType = Pool>
+    using unique_pool_ptr = std::unique_ptr<T, PoolDeleter<T, PoolType>>;
 
     // Single object version
-    template<typename T, typename... Args>
+    template<typename T, typename PoolType, typename... Args>
         requires (!std::is_array_v<T>)
-    constexpr unique_pool_ptr<T> make_pool_unique(spallocator::Pool& pool, Args&&... args)
+    constexpr unique_pool_ptr<T, PoolType> make_pool_unique(PoolType& pool, Args&&... args)
     {
         void* mem = pool.allocate(sizeof(T), alignof(T));
         T* obj = new (mem) T(std::forward<Args>(args)...);
-        return unique_pool_ptr<T>(obj, PoolDeleter<T>{pool});
+        return unique_pool_ptr<T, PoolType>(obj, PoolDeleter<T, PoolType>{pool});
     }
 
     // Unknown bound array version
-    template<typename T>
+    template<typename T, typename PoolType>
         requires std::is_unbounded_array_v<T>
-    constexpr unique_pool_ptr<T> make_pool_unique(spallocator::Pool& pool, std::size_t size)
+    constexpr unique_pool_ptr<T, PoolType> make_pool_unique(PoolType& pool, std::size_t size)
     {
         using ElementType = std::remove_extent_t<T>;
 
         std::size_t array_size = sizeof(ElementType) * size;
-        std::size_t alignment = alignof(ElementType) > alignof(std::size_t) ?
-                                alignof(ElementType) : alignof(std::size_t);
+        std::size_t alignment = PoolDeleter<T, PoolType>::arrayAlignment();
 
         // Allocate memory for header + array
         std::byte* mem = pool.allocate(array_size, alignment);
@@ -117,13 +123,13 @@ namespace spallocator
             new (&array_ptr[i]) ElementType();
         }
 
-        return unique_pool_ptr<T>(array_ptr, PoolDeleter<T>{pool, size});
+        return unique_pool_ptr<T, PoolType>(array_ptr, PoolDeleter<T, PoolType>{pool, size});
     }
 
     // Known bound array version (deleted - use std::array instead)
-    template<typename T, typename... Args>
+    template<typename T, typename PoolType, typename... Args>
         requires std::is_bounded_array_v<T>
-    void make_pool_unique(spallocator::Pool& pool, Args&&... args) = delete;
+    void make_pool_unique(PoolType& pool, Args&&... args) = delete;
 
 
     // =========================================================================
@@ -141,7 +147,7 @@ namespace spallocator
     // 4. Propagates on container copy/move/swap (POCCA/POCMA/POCS all false)
     //    because the pool is not owned and must not transfer
 
-    template<typename T>
+    template<typename T, typename PoolType = Pool>
     class PoolAllocator
     {
     public:
@@ -154,14 +160,14 @@ namespace spallocator
         using is_always_equal = std::false_type;  // Different pools = different allocators
 
         // Constructor - requires a pool reference
-        explicit PoolAllocator(spallocator::Pool& pool) noexcept : pool_ref(pool) {}
+        explicit PoolAllocator(PoolType& pool) noexcept : pool_ref(pool) {}
 
         // Copy constructor
         PoolAllocator(const PoolAllocator&) noexcept = default;
 
         // Rebind constructor - allows allocating different types with same pool
         template<typename U>
-        PoolAllocator(const PoolAllocator<U>& other) noexcept : pool_ref(other.pool_ref) {}
+        PoolAllocator(const PoolAllocator<U, PoolType>& other) noexcept : pool_ref(other.pool_ref) {}
 
         // Allocate n objects of type T
         [[nodiscard]] T* allocate(std::size_t n)
@@ -181,29 +187,30 @@ namespace spallocator
         // Deallocate memory
         void deallocate(T* p, std::size_t n) noexcept
         {
-            (void)n;  // Size not needed for pool deallocation
-            pool_ref.deallocate(reinterpret_cast<std::byte*>(p));
+            // n is the count passed to allocate(), so the pool can pick the
+            // size class without looking the pointer up
+            pool_ref.deallocate(reinterpret_cast<std::byte*>(p), n * sizeof(T), alignof(T));
         }
 
         // Equality comparison - allocators are equal only if they use the same pool
         template<typename U>
-        friend bool operator==(const PoolAllocator& lhs, const PoolAllocator<U>& rhs) noexcept
+        friend bool operator==(const PoolAllocator& lhs, const PoolAllocator<U, PoolType>& rhs) noexcept
         {
             return &lhs.pool_ref == &rhs.pool_ref;
         }
 
         template<typename U>
-        friend bool operator!=(const PoolAllocator& lhs, const PoolAllocator<U>& rhs) noexcept
+        friend bool operator!=(const PoolAllocator& lhs, const PoolAllocator<U, PoolType>& rhs) noexcept
         {
             return !(lhs == rhs);
         }
 
         // Public access to pool for rebind constructor
-        template<typename U>
+        template<typename U, typename OtherPool>
         friend class PoolAllocator;
 
     private:
-        spallocator::Pool& pool_ref;
+        PoolType& pool_ref;
     };
 
     // =========================================================================
@@ -223,11 +230,11 @@ namespace spallocator
     // - Weak pointer support
     // - Single allocation for object + control block (like std::make_shared)
 
-    template<typename T, typename... Args>
+    template<typename T, typename PoolType, typename... Args>
         requires (!std::is_array_v<T>)
-    std::shared_ptr<T> make_pool_shared(spallocator::Pool& pool, Args&&... args)
+    std::shared_ptr<T> make_pool_shared(PoolType& pool, Args&&... args)
     {
-        PoolAllocator<T> alloc(pool);
+        PoolAllocator<T, PoolType> alloc(pool);
         return std::allocate_shared<T>(alloc, std::forward<Args>(args)...);
     }
 
@@ -241,12 +248,12 @@ namespace spallocator
     // std::shared_ptr<T[]> tracks array size internally in the control block.
     // This means we don't need custom size tracking.
 
-    template<typename T>
+    template<typename T, typename PoolType>
         requires std::is_unbounded_array_v<T>
-    std::shared_ptr<T> make_pool_shared(spallocator::Pool& pool, std::size_t size)
+    std::shared_ptr<T> make_pool_shared(PoolType& pool, std::size_t size)
     {
         using ElementType = std::remove_extent_t<T>;
-        PoolAllocator<ElementType> alloc(pool);
+        PoolAllocator<ElementType, PoolType> alloc(pool);
         return std::allocate_shared<T>(alloc, size);
     }
 
@@ -256,20 +263,20 @@ namespace spallocator
     // Example:
     //   auto arr = make_pool_shared<int[]>(pool, 100, 42);  // 100 ints, all = 42
 
-    template<typename T>
+    template<typename T, typename PoolType>
         requires std::is_unbounded_array_v<T>
-    std::shared_ptr<T> make_pool_shared(spallocator::Pool& pool, std::size_t size,
+    std::shared_ptr<T> make_pool_shared(PoolType& pool, std::size_t size,
                                         const std::remove_extent_t<T>& init_value)
     {
         using ElementType = std::remove_extent_t<T>;
-        PoolAllocator<ElementType> alloc(pool);
+        PoolAllocator<ElementType, PoolType> alloc(pool);
         return std::allocate_shared<T>(alloc, size, init_value);
     }
 
     // Known bound array version (deleted - use std::array instead)
-    template<typename T, typename... Args>
+    template<typename T, typename PoolType, typename... Args>
         requires std::is_bounded_array_v<T>
-    void make_pool_shared(spallocator::Pool& pool, Args&&... args) = delete;
+    void make_pool_shared(PoolType& pool, Args&&... args) = delete;
 
 }; // namespace spallocator
 
@@ -33,10 +33,14 @@
 #ifndef SPINLOCK_HPP_
 #define SPINLOCK_HPP_
 
+#include <algorithm>
+#include <array>
 #include <atomic>
-#include <thread>
-#include <random>
+#include <bit>
 #include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <thread>
 
 
 // ThreadSanitizer annotations for custom synchronization primitives
@@ -60,76 +64,257 @@ extern "C" {
 #endif
 
 
-class SpinLock
+//
+// The interface the slabs take their lock through: BasicLockable plus
+// try_lock(), so std::scoped_lock and std::unique_lock both work. SpinLock
+// is the default; queuelock.hpp has FIFO alternatives.
+//
+template<typename T>
+concept Lockable = requires(T& lock)
+{
+    lock.lock();
+    { lock.try_lock() } -> std::convertible_to<bool>;
+    lock.unlock();
+};
+
+
+// Tell the CPU we're in a spin-wait: it stops speculating ahead on the
+// loop and yields pipeline resources to a sibling hyperthread
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+
+//
+// Lock statistics. BasicSpinLock takes a stats policy: NoLockStats, whose
+// hooks are empty and take no space, or LockStats, which counts
+// acquisitions, contention, spin iterations and parks and keeps wait- and
+// hold-time histograms. SpinLock is the uninstrumented lock unless the
+// build defines SPALLOC_LOCK_STATS; InstrumentedSpinLock is always
+// instrumented, for picking per pool (BasicPool<Classes, InstrumentedSpinLock>).
+//
+struct LockStatsSnapshot
+{
+    // bucket 0 counts times under 1 ns, bucket i > 0 times in
+    // [2^(i-1), 2^i) ns; the last bucket also takes anything longer
+    static constexpr std::size_t histogram_buckets{32};
+
+    uint64_t acquisitions{0};
+    uint64_t contended{0};          // lock() calls that had to wait
+    uint64_t failed_try_locks{0};
+    uint64_t spins{0};              // spin iterations while waiting
+    uint64_t parks{0};              // futex waits while waiting
+    std::array<uint64_t, histogram_buckets> wait_ns{};  // contended lock() calls only
+    std::array<uint64_t, histogram_buckets> hold_ns{};
+
+    LockStatsSnapshot& operator+=(const LockStatsSnapshot& other)
+    {
+        acquisitions += other.acquisitions;
+        contended += other.contended;
+        failed_try_locks += other.failed_try_locks;
+        spins += other.spins;
+        parks += other.parks;
+        for (std::size_t i = 0; i < histogram_buckets; ++i)
+        {
+            wait_ns[i] += other.wait_ns[i];
+            hold_ns[i] += other.hold_ns[i];
+        }
+        return *this;
+    }
+};
+
+
+struct NoLockStats
+{
+    struct TimePoint {};
+    static TimePoint now() { return {}; }
+
+    void acquired() {}
+    void acquiredAfterWait(TimePoint /* wait_start */, uint64_t /* spins */, uint64_t /* parks */) {}
+    void failedTryLock() {}
+    void releasing() {}
+    LockStatsSnapshot snapshot() const { return {}; }
+};
+
+
+class LockStats
 {
 public:
-    SpinLock() = default;
-    ~SpinLock() = default;
+    using TimePoint = std::chrono::steady_clock::time_point;
+    static TimePoint now() { return std::chrono::steady_clock::now(); }
 
-    void lock()
+    // Everything but failedTryLock() runs with the lock held, so the
+    // counters only need to be atomic for snapshot() to read them while
+    // the lock is in use
+    void acquired()
     {
-        // Single static instance per thread; efficient and thread safe
-        // without requiring additional costly synchronization
-        thread_local static std::minstd_rand gen{std::random_device{}()};
-        thread_local static std::uniform_int_distribution<int> dist{1, 100};
-
-        // Incrementing time to wait if we get contention. This is an
-        // escalating backoff strategy to avoid the thundering herd problem
-        // when the resource becomes available. This doesn't have to be highly
-        // random, and it doesn't even have to be highly accurate on the wait;
-        // the more important attribute is that it differentiates the wait
-        // times between different threads to encourage ordered acquisition
-        // attempts.
-        std::chrono::nanoseconds wait_time{dist(gen)};
-
-        // Test-and-Test-and-set (TTAS) spin lock with escalating backoff
-        while (true)
+        bump(acquisitions);
+        hold_start = now();
+    }
+
+    void acquiredAfterWait(TimePoint wait_start, uint64_t spin_count, uint64_t park_count)
+    {
+        hold_start = now();
+        bump(acquisitions);
+        bump(contended);
+        bump(spins, spin_count);
+        bump(parks, park_count);
+        bump(wait_ns[bucket(hold_start - wait_start)]);
+    }
+
+    void failedTryLock()
+    {
+        failed_try_locks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void releasing()
+    {
+        bump(hold_ns[bucket(now() - hold_start)]);
+    }
+
+    LockStatsSnapshot snapshot() const
+    {
+        LockStatsSnapshot out;
+        out.acquisitions = acquisitions.load(std::memory_order_relaxed);
+        out.contended = contended.load(std::memory_order_relaxed);
+        out.failed_try_locks = failed_try_locks.load(std::memory_order_relaxed);
+        out.spins = spins.load(std::memory_order_relaxed);
+        out.parks = parks.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < LockStatsSnapshot::histogram_buckets; ++i)
         {
-            int backoff_count = 0;
+            out.wait_ns[i] = wait_ns[i].load(std::memory_order_relaxed);
+            out.hold_ns[i] = hold_ns[i].load(std::memory_order_relaxed);
+        }
+        return out;
+    }
 
-            // First, spin while the lock appears to be held
-            for (int i = 0; i < 100; ++i)
-            {
-                if (!lock_flag.test(std::memory_order_relaxed))
-                {
-                    // Lock appears free, try to acquire
-                    break;
-                }
-                std::this_thread::yield();
-            }
+private: // methods
+    static void bump(std::atomic<uint64_t>& counter, uint64_t by = 1)
+    {
+        // single writer (the lock holder), so no read-modify-write needed
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
 
-            // Then, attempt to acquire the lock
-            if (!lock_flag.test_and_set(std::memory_order_acquire))
-            {
-                TSAN_ANNOTATE_HAPPENS_AFTER(this);
-                return; // Lock acquired
-            }
+    static std::size_t bucket(std::chrono::steady_clock::duration elapsed)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        return std::min<std::size_t>(std::bit_width(static_cast<uint64_t>(std::max<int64_t>(ns, 0))),
+                                     LockStatsSnapshot::histogram_buckets - 1);
+    }
 
-            // Failed to acquire - use escalating backoff
-            if (backoff_count < 10)
-            {
-                std::this_thread::sleep_for(wait_time);
-                wait_time += wait_time;
-                ++backoff_count;
-            }
-            else
+private: // data members
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contended{0};
+    std::atomic<uint64_t> failed_try_locks{0};
+    std::atomic<uint64_t> spins{0};
+    std::atomic<uint64_t> parks{0};
+    std::array<std::atomic<uint64_t>, LockStatsSnapshot::histogram_buckets> wait_ns{};
+    std::array<std::atomic<uint64_t>, LockStatsSnapshot::histogram_buckets> hold_ns{};
+    TimePoint hold_start{};     // written and read by the holder only
+};
+
+
+//
+// Adaptive lock: a short bounded spin for the common case of a lock held
+// for a few dozen cycles, then parking on the lock word (a futex on Linux,
+// via C++20 atomic wait). Parked threads are counted, so unlock() only
+// makes the wake call when somebody is actually waiting.
+//
+template<typename Stats>
+class BasicSpinLock
+{
+public:
+    BasicSpinLock() = default;
+    ~BasicSpinLock() = default;
+
+    void lock()
+    {
+        if (tryAcquire())
+        {
+            lock_stats.acquired();
+            return;
+        }
+        auto wait_start = Stats::now();
+
+        // Test-and-Test-and-set (TTAS): spin on a plain load, which stays
+        // in the local cache, and only attempt the write once the lock
+        // looks free
+        for (int i = 0; i < spin_limit; ++i)
+        {
+            cpuRelax();
+            if (!locked.load(std::memory_order_relaxed) && tryAcquire())
             {
-                // After 10 attempts, use efficient blocking
-                lock_flag.wait(true, std::memory_order_relaxed);
-                // Loop back to try acquiring again
+                lock_stats.acquiredAfterWait(wait_start, i + 1, 0);
+                return;
             }
         }
+
+        // Still held: park until unlock() wakes us. The waiter count is
+        // raised before the final attempt, and both it and unlock()'s
+        // store are sequentially consistent, so either unlock() sees the
+        // count and wakes us, or our exchange sees the lock free.
+        uint64_t parks = 0;
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        while (locked.exchange(1, std::memory_order_seq_cst))
+        {
+            ++parks;
+            locked.wait(1, std::memory_order_relaxed);
+        }
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        TSAN_ANNOTATE_HAPPENS_AFTER(this);
+        lock_stats.acquiredAfterWait(wait_start, spin_limit, parks);
     }
 
     bool try_lock()
     {
-        if (lock_flag.test(std::memory_order_relaxed))
+        if (tryAcquire())
+        {
+            lock_stats.acquired();
+            return true;
+        }
+        lock_stats.failedTryLock();
+        return false;
+    }
+
+    void unlock()
+    {
+        lock_stats.releasing();
+        TSAN_ANNOTATE_HAPPENS_BEFORE(this);
+        locked.store(0, std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_seq_cst) != 0)
+        {
+            locked.notify_one();
+        }
+    }
+
+    // all zero for an uninstrumented lock
+    LockStatsSnapshot stats() const
+    {
+        return lock_stats.snapshot();
+    }
+
+private: // methods
+    BasicSpinLock(const BasicSpinLock&) = delete;
+    BasicSpinLock& operator=(const BasicSpinLock&) = delete;
+    BasicSpinLock(BasicSpinLock&&) = delete;
+    BasicSpinLock& operator=(BasicSpinLock&&) = delete;
+
+    bool tryAcquire()
+    {
+        if (locked.load(std::memory_order_relaxed))
         {
             return false; // Lock is already held elsewhere
         }
 
         // Attempt to acquire the lock without blocking
-        if (!lock_flag.test_and_set(std::memory_order_acquire))
+        if (!locked.exchange(1, std::memory_order_acquire))
         {
             TSAN_ANNOTATE_HAPPENS_AFTER(this);
             return true; // Lock acquired
@@ -138,22 +323,27 @@ public:
         return false;
     }
 
-    void unlock()
-    {
-        TSAN_ANNOTATE_HAPPENS_BEFORE(this);
-        lock_flag.clear(std::memory_order_release);
-        lock_flag.notify_one();
-    }
-
-private: // methods
-    SpinLock(const SpinLock&) = delete;
-    SpinLock& operator=(const SpinLock&) = delete;
-    SpinLock(SpinLock&&) = delete;
-    SpinLock& operator=(SpinLock&&) = delete;
-
 private: // data members
-    std::atomic_flag lock_flag = ATOMIC_FLAG_INIT;
+    // about 1-5 us of pause instructions before parking
+    static constexpr int spin_limit{100};
+
+    // 32-bit words, which atomic wait/notify map directly onto a futex
+    std::atomic<uint32_t> locked{0};
+    std::atomic<uint32_t> waiters{0};
+    [[no_unique_address]] Stats lock_stats;
 };
 
 
+#ifdef SPALLOC_LOCK_STATS
+using SpinLock = BasicSpinLock<LockStats>;
+#else
+using SpinLock = BasicSpinLock<NoLockStats>;
+static_assert(sizeof(SpinLock) == 2 * sizeof(uint32_t), "Uninstrumented SpinLock must carry no stats");
+#endif
+using InstrumentedSpinLock = BasicSpinLock<LockStats>;
+
+static_assert(Lockable<SpinLock>);
+static_assert(Lockable<InstrumentedSpinLock>);
+
+
 #endif // SPINLOCK_HPP_
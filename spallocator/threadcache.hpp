@@ -0,0 +1,556 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2025, Michael VanLoon
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef THREADCACHE_HPP_
+#define THREADCACHE_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+    #include <sched.h>
+    #define SPALLOCATOR_HAS_GETCPU 1
+#endif
+
+#include "helper.hpp"
+#include "spinlock.hpp"
+#include "slab.hpp"
+
+
+namespace spallocator
+{
+
+    class ThreadCache;
+
+
+    //
+    // ClassCounts are the operations a pool has seen for one size class
+    // (or for its large blocks) when it is collecting statistics
+    //
+    struct ClassCounts
+    {
+        uint64_t allocations{0};
+        uint64_t frees{0};
+        uint64_t requested_bytes{0};
+    };
+
+
+    //
+    // ThreadCacheRegistry is shared (via shared_ptr) between a Pool and
+    // every ThreadCache created for it. It lets the two sides outlive each
+    // other safely: whichever goes away first takes the registry lock and
+    // either flushes (thread exit, pool alive) or detaches (pool destroyed,
+    // threads still running) the caches.
+    //
+    struct ThreadCacheRegistry
+    {
+        SpinLock lock;
+        bool pool_alive{true};
+        std::vector<ThreadCache*> caches;
+        // operation counts of caches that have already been destroyed
+        std::vector<ClassCounts> retired;
+    };
+
+
+    //
+    // ThreadCache is a per-thread, per-pool stack of free slots for each
+    // size class. The owning thread is the only one that touches the bins
+    // on the hot path, so allocate/deallocate hits need no synchronization
+    // at all. Misses refill or flush half a bin against the owning slab in
+    // a single batch, which takes the slab lock once instead of per item.
+    //
+    class ThreadCache
+    {
+    public: // methods
+        // Pop a cached slot, refilling from the slab if the bin is empty.
+        // Returns nullptr if caching is disabled for this size class. If
+        // `fresh` is given, it reports whether the slot is known to be
+        // untouched since its pages were mapped (and so reads as zero).
+        std::byte* allocate(std::size_t slab_index, AbstractSlab* slab, std::size_t size, bool* fresh = nullptr);
+
+        // Push a slot into the bin, flushing half of it to the slab first
+        // if the bin is full. Returns false if caching is disabled for this
+        // size class and the caller must free directly to the slab.
+        bool deallocate(std::size_t slab_index, AbstractSlab* slab, std::byte* item);
+
+        // Return every cached slot to its slab
+        void flush();
+
+        // Operation counters, indexed by size class with one extra entry
+        // for large blocks. Only the owning thread writes them, so a count
+        // is a relaxed load and store rather than an atomic increment;
+        // other threads may read them at any time.
+        void countAllocations(std::size_t class_index, std::size_t count, std::size_t bytes);
+        void countFrees(std::size_t class_index, std::size_t count);
+
+        // Add this cache's counters to `totals`, growing it if needed
+        void addCounts(std::vector<ClassCounts>& totals) const;
+
+        ThreadCache(std::shared_ptr<ThreadCacheRegistry> registry,
+                    std::span<const std::size_t> depths);
+        ~ThreadCache();
+
+    private: // types
+        struct Bin
+        {
+            AbstractSlab* slab{nullptr};
+            std::size_t depth{0};
+            std::vector<std::byte*> items;
+        };
+
+        struct Counters
+        {
+            std::atomic<uint64_t> allocations{0};
+            std::atomic<uint64_t> frees{0};
+            std::atomic<uint64_t> requested_bytes{0};
+        };
+
+        static void bump(std::atomic<uint64_t>& counter, uint64_t amount)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+
+    private: // methods
+        ThreadCache(const ThreadCache&) = delete;
+        ThreadCache& operator=(const ThreadCache&) = delete;
+        ThreadCache(ThreadCache&&) = delete;
+        ThreadCache& operator=(ThreadCache&&) = delete;
+
+        void flushBin(Bin& bin, std::size_t count);
+
+        // Called by the pool on destruction; the slabs are about to go
+        // away, so anything still cached is simply forgotten
+        void detach();
+
+        friend class ThreadCacheSet;
+        template<typename SizeClassTable, Lockable Lock>
+        friend class BasicPool;
+
+    private: // data members
+        std::shared_ptr<ThreadCacheRegistry> registry;
+        std::vector<Bin> bins;
+        std::vector<Counters> counters;
+    };
+
+
+    //
+    // ThreadCacheSet is the thread_local owner of all of a thread's caches,
+    // one per pool that the thread has touched. Its destructor runs at
+    // thread exit and hands every cached slot back to its pool.
+    //
+    class ThreadCacheSet
+    {
+    public: // methods
+        // Find (or create and register) this thread's cache for a pool
+        static ThreadCache& get(const std::shared_ptr<ThreadCacheRegistry>& registry,
+                                std::span<const std::size_t> depths);
+
+        ThreadCacheSet() = default;
+        ~ThreadCacheSet();
+
+    private: // methods
+        ThreadCacheSet(const ThreadCacheSet&) = delete;
+        ThreadCacheSet& operator=(const ThreadCacheSet&) = delete;
+        ThreadCacheSet(ThreadCacheSet&&) = delete;
+        ThreadCacheSet& operator=(ThreadCacheSet&&) = delete;
+
+        ThreadCache& lookup(const std::shared_ptr<ThreadCacheRegistry>& registry,
+                            std::span<const std::size_t> depths);
+
+    private: // data members
+        std::vector<std::unique_ptr<ThreadCache>> caches;
+        ThreadCache* last_used{nullptr};
+    };
+
+
+    //
+    // PerCpuCache is the alternative to per-thread caches for processes with
+    // many mostly idle threads: one ThreadCache-style set of bins per CPU
+    // instead of per thread, so cache memory is bounded by the core count.
+    //
+    // The current CPU comes from sched_getcpu(), which recent glibc serves
+    // from the rseq area registered for every thread, so it is a plain
+    // load. A thread can be migrated between reading the CPU and using the
+    // bins, so each CPU's bins are guarded by a lock; it is only contended
+    // when that happens (or when a thread is preempted while holding it),
+    // and then the caller skips the cache and goes to the slab rather
+    // than wait.
+    //
+    class PerCpuCache
+    {
+    public: // methods
+        // True if the current CPU can be queried on this platform
+        static bool supported();
+
+        // See ThreadCache; both also return nullptr/false if this CPU's
+        // bins are busy
+        std::byte* allocate(std::size_t slab_index, AbstractSlab* slab, std::size_t size, bool* fresh = nullptr);
+        bool deallocate(std::size_t slab_index, AbstractSlab* slab, std::byte* item);
+
+        // Return every CPU's cached slots to their slabs
+        void flush();
+
+        PerCpuCache(const std::shared_ptr<ThreadCacheRegistry>& registry,
+                    std::span<const std::size_t> depths);
+        ~PerCpuCache() = default;
+
+    private: // types
+        // one cache line per CPU's lock so CPUs don't false-share
+        struct alignas(64) Shard
+        {
+            SpinLock lock;
+            std::unique_ptr<ThreadCache> cache;
+        };
+
+    private: // methods
+        PerCpuCache(const PerCpuCache&) = delete;
+        PerCpuCache& operator=(const PerCpuCache&) = delete;
+        PerCpuCache(PerCpuCache&&) = delete;
+        PerCpuCache& operator=(PerCpuCache&&) = delete;
+
+        Shard& currentShard();
+
+    private: // data members
+        std::vector<Shard> shards;
+    };
+
+
+    inline ThreadCache::ThreadCache(std::shared_ptr<ThreadCacheRegistry> reg,
+                                    std::span<const std::size_t> depths)
+        : registry(std::move(reg)), bins(depths.size()), counters(depths.size() + 1)
+    {
+        for (std::size_t i = 0; i < depths.size(); ++i)
+        {
+            bins[i].depth = depths[i];
+        }
+
+        std::scoped_lock<SpinLock> guard(registry->lock);
+        registry->caches.push_back(this);
+    }
+
+
+    inline ThreadCache::~ThreadCache()
+    {
+        std::scoped_lock<SpinLock> guard(registry->lock);
+        if (registry->pool_alive)
+        {
+            addCounts(registry->retired);
+            try
+            {
+                flush();
+            }
+            catch (const std::exception& e)
+            {
+                // a double free was detected while draining the cache; there
+                // is no caller left to report it to at thread exit
+                debug_println("ThreadCache flush failed: {}", e.what());
+            }
+        }
+        std::erase(registry->caches, this);
+    }
+
+
+    inline std::byte* ThreadCache::allocate(std::size_t slab_index, AbstractSlab* slab, std::size_t size, bool* fresh)
+    {
+        Bin& bin = bins[slab_index];
+        if (bin.depth == 0)
+        {
+            return nullptr;
+        }
+
+        if (bin.items.empty())
+        {
+            // refill half the bin so a following free doesn't immediately
+            // overflow it again
+            std::size_t count = std::max<std::size_t>(1, bin.depth / 2);
+            bin.slab = slab;
+            bin.items.resize(count);
+            // refilled slots keep their fresh tag until they are handed out
+            bin.items.resize(slab->allocateTaggedBatch(size, bin.items));
+            debug_println("ThreadCache refilled {} items for slab {}", bin.items.size(), slab_index);
+            if (bin.items.empty())
+            {
+                return nullptr;
+            }
+        }
+
+        std::byte* item = bin.items.back();
+        bin.items.pop_back();
+        return AbstractSlab::untag(item, fresh);
+    }
+
+
+    inline bool ThreadCache::deallocate(std::size_t slab_index, AbstractSlab* slab, std::byte* item)
+    {
+        Bin& bin = bins[slab_index];
+        if (bin.depth == 0)
+        {
+            return false;
+        }
+
+        if constexpr (DEBUG_BUILD)
+        {
+            // a slot freed twice would sit in the bin twice and be handed to
+            // two owners; catch it here while the caller can still be told
+            for (auto cached : bin.items)
+            {
+                if (AbstractSlab::untag(cached) == item)
+                {
+                    throw std::invalid_argument("Item is already free");
+                }
+            }
+        }
+
+        bin.slab = slab;
+        bin.items.push_back(item);
+        if (bin.items.size() > bin.depth)
+        {
+            try
+            {
+                flushBin(bin, std::max<std::size_t>(1, bin.depth / 2));
+            }
+            catch (const std::invalid_argument& e)
+            {
+                // an earlier double free that slipped into the bin; this
+                // item is already cached, so its caller did nothing wrong
+                debug_println("ThreadCache flush failed: {}", e.what());
+            }
+        }
+        return true;
+    }
+
+
+    inline void ThreadCache::flushBin(Bin& bin, std::size_t count)
+    {
+        count = std::min(count, bin.items.size());
+        if (count == 0)
+        {
+            return;
+        }
+
+        // flush the oldest entries; the most recently freed slots are the
+        // ones most likely to still be hot in this core's cache. Refilled
+        // slots that were never handed out drop their fresh tag.
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            bin.items[i] = AbstractSlab::untag(bin.items[i]);
+        }
+        std::span<std::byte* const> batch(bin.items.data(), count);
+        try
+        {
+            bin.slab->deallocateBatch(batch);
+        }
+        catch (...)
+        {
+            // the slab still took every valid item; don't offer them twice
+            bin.items.erase(bin.items.begin(), bin.items.begin() + count);
+            throw;
+        }
+        bin.items.erase(bin.items.begin(), bin.items.begin() + count);
+    }
+
+
+    inline void ThreadCache::flush()
+    {
+        for (auto& bin : bins)
+        {
+            flushBin(bin, bin.items.size());
+        }
+    }
+
+
+    inline void ThreadCache::countAllocations(std::size_t class_index, std::size_t count, std::size_t bytes)
+    {
+        Counters& counter = counters[class_index];
+        bump(counter.allocations, count);
+        bump(counter.requested_bytes, bytes);
+    }
+
+
+    inline void ThreadCache::countFrees(std::size_t class_index, std::size_t count)
+    {
+        bump(counters[class_index].frees, count);
+    }
+
+
+    inline void ThreadCache::addCounts(std::vector<ClassCounts>& totals) const
+    {
+        if (totals.size() < counters.size())
+        {
+            totals.resize(counters.size());
+        }
+        for (std::size_t i = 0; i < counters.size(); ++i)
+        {
+            totals[i].allocations += counters[i].allocations.load(std::memory_order_relaxed);
+            totals[i].frees += counters[i].frees.load(std::memory_order_relaxed);
+            totals[i].requested_bytes += counters[i].requested_bytes.load(std::memory_order_relaxed);
+        }
+    }
+
+
+    inline void ThreadCache::detach()
+    {
+        for (auto& bin : bins)
+        {
+            bin.items.clear();
+            bin.slab = nullptr;
+        }
+    }
+
+
+    inline ThreadCache& ThreadCacheSet::get(const std::shared_ptr<ThreadCacheRegistry>& registry,
+                                            std::span<const std::size_t> depths)
+    {
+        thread_local ThreadCacheSet set;
+        return set.lookup(registry, depths);
+    }
+
+
+    inline ThreadCache& ThreadCacheSet::lookup(const std::shared_ptr<ThreadCacheRegistry>& registry,
+                                               std::span<const std::size_t> depths)
+    {
+        // most threads work with a single pool; make that the fast path
+        if (last_used && last_used->registry == registry)
+        {
+            return *last_used;
+        }
+
+        for (auto& cache : caches)
+        {
+            if (cache->registry == registry)
+            {
+                last_used = cache.get();
+                return *last_used;
+            }
+        }
+
+        // first use of this pool on this thread; also drop caches for
+        // pools that have since been destroyed
+        std::erase_if(caches, [](const std::unique_ptr<ThreadCache>& cache) {
+            std::scoped_lock<SpinLock> guard(cache->registry->lock);
+            return !cache->registry->pool_alive;
+        });
+
+        caches.push_back(std::make_unique<ThreadCache>(registry, depths));
+        last_used = caches.back().get();
+        return *last_used;
+    }
+
+
+    inline bool PerCpuCache::supported()
+    {
+    #ifdef SPALLOCATOR_HAS_GETCPU
+        return sched_getcpu() >= 0;
+    #else
+        return false;
+    #endif
+    }
+
+
+    inline PerCpuCache::PerCpuCache(const std::shared_ptr<ThreadCacheRegistry>& registry,
+                                    std::span<const std::size_t> depths)
+        : shards(std::max(1u, std::thread::hardware_concurrency()))
+    {
+        // registered like any thread's cache, so the pool's destructor
+        // detaches these too
+        for (auto& shard : shards)
+        {
+            shard.cache = std::make_unique<ThreadCache>(registry, depths);
+        }
+    }
+
+
+    inline PerCpuCache::Shard& PerCpuCache::currentShard()
+    {
+    #ifdef SPALLOCATOR_HAS_GETCPU
+        int cpu = sched_getcpu();
+        // CPU ids can be sparse or exceed the online count (hotplug)
+        return shards[cpu < 0 ? 0 : static_cast<std::size_t>(cpu) % shards.size()];
+    #else
+        return shards[0];
+    #endif
+    }
+
+
+    inline std::byte* PerCpuCache::allocate(std::size_t slab_index, AbstractSlab* slab, std::size_t size, bool* fresh)
+    {
+        Shard& shard = currentShard();
+        std::unique_lock<SpinLock> guard(shard.lock, std::try_to_lock);
+        if (!guard.owns_lock())
+        {
+            return nullptr;
+        }
+        return shard.cache->allocate(slab_index, slab, size, fresh);
+    }
+
+
+    inline bool PerCpuCache::deallocate(std::size_t slab_index, AbstractSlab* slab, std::byte* item)
+    {
+        Shard& shard = currentShard();
+        std::unique_lock<SpinLock> guard(shard.lock, std::try_to_lock);
+        if (!guard.owns_lock())
+        {
+            return false;
+        }
+        return shard.cache->deallocate(slab_index, slab, item);
+    }
+
+
+    inline void PerCpuCache::flush()
+    {
+        for (auto& shard : shards)
+        {
+            std::scoped_lock<SpinLock> guard(shard.lock);
+            shard.cache->flush();
+        }
+    }
+
+
+    inline ThreadCacheSet::~ThreadCacheSet()
+    {
+        last_used = nullptr;
+        caches.clear();
+    }
+
+}; // namespace spallocator
+
+
+#endif // THREADCACHE_HPP_
@@ -30,13 +30,24 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sys/mman.h>
 #include <gtest/gtest.h>
 
 #include "spallocator/helper.hpp"
 #include "spallocator/spinlock.hpp"
+#include "spallocator/queuelock.hpp"
+#include "spallocator/bitmap.hpp"
 #include "spallocator/slab.hpp"
+#include "spallocator/freelistslab.hpp"
+#include "spallocator/atomicslab.hpp"
 #include "spallocator/pool.hpp"
+#include "spallocator/threadcache.hpp"
 #include "spallocator/lifetimeobserver.hpp"
 #include "spallocator/spallocator.hpp"
 
@@ -44,105 +55,420 @@ using namespace std::literals;
 using namespace spallocator;
 
 
+TEST(BitmapTest, FindFirst)
+{
+    // not a multiple of 64, so the last word is partial
+    Bitmap<100> bits;
+    EXPECT_TRUE(bits.none());
+    EXPECT_EQ(bits.findFirstClear(), 0u);
+    EXPECT_EQ(bits.findFirstSet(), bits.npos);
+
+    for (std::size_t i = 0; i < 70; ++i)
+    {
+        bits.set(i);
+    }
+    EXPECT_EQ(bits.count(), 70u);
+    EXPECT_EQ(bits.freeCount(), 30u);
+    EXPECT_EQ(bits.findFirstClear(), 70u);
+    EXPECT_EQ(bits.findFirstSet(), 0u);
+    EXPECT_EQ(bits.findFirstSet(65), 65u);
+    EXPECT_EQ(bits.findFirstSet(70), bits.npos);
+
+    bits.reset(3);
+    bits.reset(3);  // idempotent, count must not drift
+    EXPECT_EQ(bits.count(), 69u);
+    EXPECT_EQ(bits.findFirstClear(), 3u);
+
+    bits.set();
+    EXPECT_TRUE(bits.all());
+    EXPECT_EQ(bits.findFirstClear(), bits.npos);
+    bits.reset(99);
+    EXPECT_EQ(bits.findFirstClear(), 99u);
+}
+
+
+TEST(BitmapTest, Growable)
+{
+    GrowableBitmap bits;
+    EXPECT_EQ(bits.size(), 0u);
+    EXPECT_EQ(bits.findFirstSet(), bits.npos);
+
+    // grows on demand; new bits start clear
+    bits.resize(5000);
+    EXPECT_EQ(bits.size(), 5000u);
+    EXPECT_EQ(bits.findFirstSet(), bits.npos);
+    bits.set(4500);
+    bits.set(70);
+    EXPECT_EQ(bits.findFirstSet(), 70u);
+    bits.reset(70);
+    EXPECT_EQ(bits.findFirstSet(), 4500u);
+
+    // growing keeps existing bits; shrinking drops the ones cut off
+    bits.resize(9000);
+    EXPECT_TRUE(bits.test(4500));
+    bits.resize(4500);
+    EXPECT_EQ(bits.findFirstSet(), bits.npos);
+    bits.resize(9000);
+    EXPECT_FALSE(bits.test(4500));
+}
+
+
 TEST(SlabTest, CreateSlabs)
 {
     {
         Slab<64> slab;
         EXPECT_EQ(slab.getElemSize(), 64u);
-        EXPECT_EQ(slab.getAllocSize(), 4_KB);
-        EXPECT_EQ(slab.getAllocatedMemory(), 4_KB);
+        EXPECT_EQ(slab.getAllocSize(), 64_KB);
+        EXPECT_EQ(slab.getAllocatedMemory(), 0u);
     }
 
     {
         Slab<128> slab;
         EXPECT_EQ(slab.getElemSize(), 128u);
-        EXPECT_EQ(slab.getAllocSize(), 4_KB);
-        EXPECT_EQ(slab.getAllocatedMemory(), 4_KB);
+        EXPECT_EQ(slab.getAllocSize(), 64_KB);
+        EXPECT_EQ(slab.getAllocatedMemory(), 0u);
     }
 
     {
         Slab<1_KB> slab;
         EXPECT_EQ(slab.getElemSize(), 1_KB);
-        EXPECT_EQ(slab.getAllocSize(), 4_KB);
-        EXPECT_EQ(slab.getAllocatedMemory(), 4_KB);
+        EXPECT_EQ(slab.getAllocSize(), 64_KB);
+        EXPECT_EQ(slab.getAllocatedMemory(), 0u);
     }
 
     {
+        // 64KB would leave a whole 2KB slot to the header
         Slab<2_KB> slab;
         EXPECT_EQ(slab.getElemSize(), 2_KB);
-        EXPECT_EQ(slab.getAllocSize(), 8_KB);
-        EXPECT_EQ(slab.getAllocatedMemory(), 8_KB);
+        EXPECT_EQ(slab.getAllocSize(), 128_KB);
+        EXPECT_EQ(slab.getAllocatedMemory(), 0u);
     }
 
     {
+        // the header costs a whole slot, so 1/64 waste takes 64 slots
         Slab<16_KB> slab;
         EXPECT_EQ(slab.getElemSize(), 16_KB);
-        EXPECT_EQ(slab.getAllocSize(), 64_KB);
-        EXPECT_EQ(slab.getAllocatedMemory(), 64_KB);
+        EXPECT_EQ(slab.getAllocSize(), 1_MB);
+        EXPECT_EQ(slab.getAllocatedMemory(), 0u);
+        EXPECT_EQ(slab.getItemsPerSlab(), 63u);
     }
 
     {
         // not an even multiple of 1024
         Slab<12336> slab;
         EXPECT_EQ(slab.getElemSize(), 12336u);
-        EXPECT_EQ(slab.getAllocSize(), 49344u);
-        EXPECT_EQ(slab.getAllocatedMemory(), 49344u);
+        EXPECT_EQ(slab.getAllocSize(), 256_KB);
+        EXPECT_EQ(slab.getAllocatedMemory(), 0u);
+        EXPECT_EQ(slab.getItemsPerSlab(), 21u);
     }
 
 }
 
 
+TEST(SlabTest, SpanSizing)
+{
+    // waste and occupancy are compile-time figures
+    static_assert(Slab<16>::getItemsPerSlab() > 4000);
+    static_assert(Slab<768>::getWasteBytes() * 64 <= 64_KB);
+    static_assert(FreeListSlab<384>::getWasteBytes() * 64 <= 64_KB);
+    static_assert(Slab<1_KB>::getOccupancy() > 0.98);
+
+    // every default size class meets the 1/64 waste target
+    []<std::size_t... Index>(std::index_sequence<Index...>) {
+        static_assert(((Slab<Pool::size_classes[Index]>::getWasteBytes() * max_span_waste_divisor <=
+                        selectBufferSize<Pool::size_classes[Index]>()) && ...));
+        static_assert(((FreeListSlab<Pool::size_classes[Index]>::getWasteBytes() * max_span_waste_divisor <=
+                        selectBufferSize<Pool::size_classes[Index]>()) && ...));
+    }(std::make_index_sequence<Pool::size_class_count>{});
+}
+
+
 TEST(SlabTest, AllocateItems)
 {
     Slab<128> slab;
+    const std::size_t per_slab = slab.getItemsPerSlab();
+
+    // the span header takes (at least) one slot
+    EXPECT_LT(per_slab, 64_KB / 128);
 
-    // initial allocation should be 4KB
-    EXPECT_EQ(slab.getAllocatedMemory(), 4_KB);
+    // no span is created until the first allocation
+    EXPECT_EQ(slab.getAllocatedMemory(), 0u);
 
     std::vector<std::byte*> items;
-    for (int i = 0; i < 32; ++i)
+    for (std::size_t i = 0; i < per_slab; ++i)
     {
         auto item = slab.allocateItem(120);
         EXPECT_NE(item, nullptr);
         items.push_back(item);
     }
 
-    // next allocation should cause a new slab to be allocated
+    // next allocation should cause a new slab to be allocated, carved
+    // from a second chunk twice the size of the first
     auto item = slab.allocateItem(120);
     EXPECT_NE(item, nullptr);
     items.push_back(item);
 
-    EXPECT_EQ(slab.getAllocatedMemory(), 8_KB);
+    EXPECT_EQ(slab.getAllocatedMemory(), 192_KB);
 
-    for (int i = 0; i < 31; ++i)
+    for (std::size_t i = 0; i < per_slab - 1; ++i)
     {
         auto item = slab.allocateItem(120);
         EXPECT_NE(item, nullptr);
         items.push_back(item);
     }
 
-    // next allocation should cause a new slab to be allocated
+    // next allocation should cause a new slab to be allocated, from
+    // the chunk that is already there
     item = slab.allocateItem(120);
     EXPECT_NE(item, nullptr);
     items.push_back(item);
 
-    EXPECT_EQ(slab.getAllocatedMemory(), 12_KB);
+    EXPECT_EQ(slab.getAllocatedMemory(), 192_KB);
 
-    // free all items
+    // free all items; the newer chunk is released, the first is kept
     for (auto it : items)
     {
         slab.deallocateItem(it);
     }
+    EXPECT_EQ(slab.getAllocatedMemory(), 64_KB);
 
     // allocate again, should reuse freed items
-    for (int i = 0; i < 65; ++i)
+    for (std::size_t i = 0; i < per_slab * 2 + 1; ++i)
     {
         auto item = slab.allocateItem(120);
         EXPECT_NE(item, nullptr);
     }
 
     // same memory allocation should persist from previous allocations
-    EXPECT_EQ(slab.getAllocatedMemory(), 12_KB);
+    EXPECT_EQ(slab.getAllocatedMemory(), 192_KB);
+}
+
+
+TEST(SlabTest, GeometricGrowth)
+{
+    Slab<64> slab;
+    const std::size_t per_slab = slab.getItemsPerSlab();
+
+    // 15 spans come from chunks of 1, 2, 4 and 8 spans
+    std::vector<std::byte*> items;
+    for (std::size_t i = 0; i < per_slab * 15; ++i)
+    {
+        items.push_back(slab.allocateItem(64));
+    }
+    EXPECT_EQ(slab.getChunkCount(), 4u);
+    EXPECT_EQ(slab.getAllocatedMemory(), 15 * 64_KB);
+
+    // one more span starts a 16-span chunk
+    items.push_back(slab.allocateItem(64));
+    EXPECT_EQ(slab.getChunkCount(), 5u);
+    EXPECT_EQ(slab.getAllocatedMemory(), 31 * 64_KB);
+
+    // freeing from the top releases chunks in reverse, always keeping the
+    // empty chunk below as a reserve
+    while (items.size() > per_slab * 3)
+    {
+        slab.deallocateItem(items.back());
+        items.pop_back();
+    }
+    EXPECT_EQ(slab.getChunkCount(), 3u);
+
+    // growing again reuses the reserve chunk, then repeats the same
+    // chunk sizes
+    for (std::size_t i = 0; i < per_slab * 12; ++i)
+    {
+        items.push_back(slab.allocateItem(64));
+    }
+    EXPECT_EQ(slab.getChunkCount(), 4u);
+    EXPECT_EQ(slab.getAllocatedMemory(), 15 * 64_KB);
+
+    for (auto item : items)
+    {
+        slab.deallocateItem(item);
+    }
+    EXPECT_EQ(slab.getChunkCount(), 1u);
+}
+
+
+TEST(SlabTest, Trim)
+{
+    Slab<64> slab;
+    const std::size_t per_slab = slab.getItemsPerSlab();
+
+    // three spans, only the first of which stays in use
+    std::vector<std::byte*> items;
+    for (std::size_t i = 0; i < per_slab * 3; ++i)
+    {
+        items.push_back(slab.allocateItem(64));
+    }
+    while (items.size() > per_slab)
+    {
+        slab.deallocateItem(items.back());
+        items.pop_back();
+    }
+
+    // nothing has been idle for an hour; with no decay, the first empty
+    // span is the hot reserve and only the item pages of the second go
+    EXPECT_EQ(slab.trim({std::chrono::hours(1), 1}), 0u);
+    EXPECT_EQ(slab.trim({std::chrono::milliseconds(0), 1}), 60_KB);
+    EXPECT_EQ(slab.trim({std::chrono::milliseconds(0), 1}), 0u);
+    EXPECT_EQ(slab.getAllocatedMemory(), 3 * 64_KB);
+
+    // decommitted spans are reused transparently
+    for (std::size_t i = 0; i < per_slab * 2; ++i)
+    {
+        items.push_back(slab.allocateItem(64));
+        std::memset(items.back(), 0x42, 64);
+    }
+    EXPECT_EQ(slab.trim({std::chrono::milliseconds(0), 0}), 0u);
+
+    for (auto item : items)
+    {
+        slab.deallocateItem(item);
+    }
+}
+
+
+// Allocate on one thread and free on several others, so frees regularly
+// find the slab lock taken and go through the remote-free list
+template<typename SlabType>
+static void crossThreadFrees(SlabType& slab)
+{
+    constexpr int per_thread = 20000;
+    constexpr int num_freers = 3;
+    std::vector<std::vector<std::byte*>> queues(num_freers);
+    std::vector<SpinLock> locks(num_freers);
+
+    std::vector<std::thread> freers;
+    for (int t = 0; t < num_freers; ++t)
+    {
+        freers.emplace_back([&, t] {
+            int freed = 0;
+            std::vector<std::byte*> batch;
+            while (freed < per_thread)
+            {
+                {
+                    std::scoped_lock<SpinLock> guard(locks[t]);
+                    batch.swap(queues[t]);
+                }
+                for (auto item : batch)
+                {
+                    slab.deallocateItem(item);
+                }
+                freed += batch.size();
+                batch.clear();
+            }
+        });
+    }
+
+    for (int i = 0; i < per_thread * num_freers; ++i)
+    {
+        auto item = slab.allocateItem(64);
+        std::memset(item, 0x77, 64);
+        std::scoped_lock<SpinLock> guard(locks[i % num_freers]);
+        queues[i % num_freers].push_back(item);
+    }
+    for (auto& thread : freers)
+    {
+        thread.join();
+    }
+
+    // trim drains any frees still pending before releasing empty spans
+    slab.trim({std::chrono::milliseconds(0), 0});
+}
+
+
+TEST(SlabTest, RemoteFree)
+{
+    {
+        Slab<64> slab;
+        crossThreadFrees(slab);
+        // nothing leaked into the remote list: all chunks but the first
+        // were released, and the first is empty
+        EXPECT_EQ(slab.getChunkCount(), 1u);
+        auto item = slab.allocateItem(64);
+        EXPECT_EQ(slab.findSlabForItem(item), 0u);
+        slab.deallocateItem(item);
+    }
+    {
+        FreeListSlab<64> slab;
+        crossThreadFrees(slab);
+        EXPECT_EQ(slab.getAllocatedMemory(), 0u);
+    }
+}
+
+
+// A lock whose try_lock() can be made to fail, to force the contended
+// (remote-free) path deterministically
+struct BusyLock
+{
+    void lock() { lock_.lock(); }
+    bool try_lock() { return !busy && lock_.try_lock(); }
+    void unlock() { lock_.unlock(); }
+
+    static inline bool busy{false};
+    std::mutex lock_;
+};
+
+
+TEST(SlabTest, ContendedFree)
+{
+    {
+        Slab<64, BusyLock> slab;
+        auto a = slab.allocateItem(64);
+        auto b = slab.allocateItem(64);
+        BusyLock::busy = true;
+        slab.deallocateItem(a);
+        std::array<std::byte*, 2> batch{nullptr, b};
+        slab.deallocateBatch(batch);
+        EXPECT_THROW(slab.deallocateItem(a + 16), std::invalid_argument);
+        BusyLock::busy = false;
+        // the deferred frees are drained by the next locked operation
+        slab.trim({std::chrono::milliseconds(0), 0});
+        EXPECT_EQ(slab.getChunkCount(), 1u);
+        EXPECT_EQ(slab.usage().used_slots, 0u);
+    }
+    if constexpr (DEBUG_BUILD)
+    {
+        // a contended double free is still caught before it can clobber
+        // the free list's link word
+        FreeListSlab<64, BusyLock> slab;
+        auto a = slab.allocateItem(64);
+        auto b = slab.allocateItem(64);
+        slab.deallocateItem(a);
+        BusyLock::busy = true;
+        EXPECT_THROW(slab.deallocateItem(a), std::invalid_argument);
+        std::array<std::byte*, 2> batch{a, b};
+        EXPECT_THROW(slab.deallocateBatch(batch), std::invalid_argument);
+        BusyLock::busy = false;
+        auto c = slab.allocateItem(64);
+        auto d = slab.allocateItem(64);
+        EXPECT_NE(c, d);
+        EXPECT_TRUE((c == a && d == b) || (c == b && d == a));
+        slab.deallocateItem(c);
+        slab.deallocateItem(d);
+        EXPECT_EQ(slab.usage().used_slots, 0u);
+    }
+}
+
+
+TEST(SlabTest, SpanLookup)
+{
+    Slab<64> slab;
+    Slab<64> other;
+
+    auto item = slab.allocateItem(64);
+    auto span_base = reinterpret_cast<std::uintptr_t>(item) & ~(slab.getAllocSize() - 1);
+    EXPECT_EQ(slab.findSlabForItem(item), std::optional<std::size_t>{0});
+
+    // interior pointers and pointers into the span header are not items
+    EXPECT_THROW(slab.deallocateItem(item + 16), std::invalid_argument);
+    EXPECT_THROW(slab.deallocateItem(reinterpret_cast<std::byte*>(span_base)), std::invalid_argument);
+
+    // a live span owned by a different slab is rejected
+    EXPECT_EQ(other.findSlabForItem(item), std::nullopt);
+    EXPECT_THROW(other.deallocateItem(item), std::invalid_argument);
+
+    slab.deallocateItem(item);
 }
 
 
@@ -164,6 +490,41 @@ TEST(SlabTest, DeallocateInvalidItem)
 }
 
 
+TEST(PoolTest, CachedDoubleFree)
+{
+    Pool pool;   // default per-thread cache
+
+    auto item = pool.allocate(64);
+    pool.deallocate(item);
+    if constexpr (DEBUG_BUILD)
+    {
+        EXPECT_THROW(pool.deallocate(item), std::invalid_argument);
+        // the slot went into the cache once, so it is handed out once
+        auto a = pool.allocate(64);
+        auto b = pool.allocate(64);
+        EXPECT_NE(a, b);
+        pool.deallocate(a);
+        pool.deallocate(b);
+    }
+    else
+    {
+        // unchecked in release; the duplicate surfaces in a later flush,
+        // which must not fail the unrelated frees that trigger it
+        pool.deallocate(item);
+        std::vector<std::byte*> items(200);
+        for (auto& it : items)
+        {
+            it = pool.allocate(64);
+        }
+        for (auto it : items)
+        {
+            EXPECT_NO_THROW(pool.deallocate(it));
+        }
+    }
+    EXPECT_NO_THROW(pool.trim());
+}
+
+
 TEST(SlabTest, Alignment)
 {
     Slab<64> slab;
@@ -184,6 +545,102 @@ TEST(SlabTest, Alignment)
 }
 
 
+TEST(FreeListSlabTest, AllocateItems)
+{
+    FreeListSlab<128> slab;
+    const std::size_t per_slab = slab.getItemsPerSlab();
+    EXPECT_EQ(slab.getAllocatedMemory(), 0u);
+
+    std::vector<std::byte*> items;
+    for (std::size_t i = 0; i < per_slab + 1; ++i)
+    {
+        auto item = slab.allocateItem(120);
+        EXPECT_NE(item, nullptr);
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(item) % 16, 0u);
+        items.push_back(item);
+    }
+
+    // one past a full span forced a second slab
+    EXPECT_EQ(slab.getAllocatedMemory(), 128_KB);
+
+    // freed slots are reused LIFO before any new slab is created
+    slab.deallocateItem(items[5]);
+    slab.deallocateItem(items[7]);
+    EXPECT_EQ(slab.allocateItem(120), items[7]);
+    EXPECT_EQ(slab.allocateItem(120), items[5]);
+
+    for (auto it : items)
+    {
+        slab.deallocateItem(it);
+    }
+
+    for (std::size_t i = 0; i < per_slab * 2; ++i)
+    {
+        EXPECT_NE(slab.allocateItem(120), nullptr);
+    }
+    EXPECT_EQ(slab.getAllocatedMemory(), 128_KB);
+}
+
+
+TEST(FreeListSlabTest, DeallocateInvalidItem)
+{
+    FreeListSlab<256> slab;
+
+    auto item1 = slab.allocateItem(200);
+    EXPECT_NE(item1, nullptr);
+
+    // misaligned pointer inside the slab
+    EXPECT_THROW(slab.deallocateItem(item1 + 8), std::invalid_argument);
+
+    // never-allocated slot
+    EXPECT_THROW(slab.deallocateItem(item1 + 256), std::invalid_argument);
+
+    slab.deallocateItem(item1);
+    if constexpr (DEBUG_BUILD)
+    {
+        // double free detection walks the free list in debug builds only
+        EXPECT_THROW(slab.deallocateItem(item1), std::invalid_argument);
+    }
+}
+
+
+TEST(FreeListSlabTest, Trim)
+{
+    FreeListSlab<256> slab;
+    const std::size_t per_slab = slab.getItemsPerSlab();
+
+    std::vector<std::byte*> items;
+    for (std::size_t i = 0; i < per_slab * 3; ++i)
+    {
+        items.push_back(slab.allocateItem(256));
+    }
+    auto survivor = items.front();
+    for (std::size_t i = 1; i < items.size(); ++i)
+    {
+        slab.deallocateItem(items[i]);
+    }
+
+    // two empty slabs; one is kept hot and the other is unmapped outright
+    EXPECT_EQ(slab.trim({std::chrono::hours(1), 1}), 0u);
+    EXPECT_EQ(slab.trim({std::chrono::milliseconds(0), 1}), slab.getAllocSize());
+    EXPECT_EQ(slab.getAllocatedMemory(), 2 * slab.getAllocSize());
+
+    // the remaining slabs, and the renumbered one, still work
+    items.clear();
+    for (std::size_t i = 0; i < per_slab * 2; ++i)
+    {
+        items.push_back(slab.allocateItem(256));
+    }
+    for (auto item : items)
+    {
+        slab.deallocateItem(item);
+    }
+    slab.deallocateItem(survivor);
+    EXPECT_EQ(slab.trim({std::chrono::milliseconds(0), 0}), 3 * slab.getAllocSize());
+    EXPECT_EQ(slab.getAllocatedMemory(), 0u);
+}
+
+
 TEST(PoolTest, Selector)
 {
     Pool pool;
@@ -231,6 +688,18 @@ TEST(PoolTest, Selector)
     EXPECT_EQ(pool.selectSlab(769), 11u);
     EXPECT_EQ(pool.selectSlab(1023), 11u);
     EXPECT_EQ(pool.selectSlab(1025), std::numeric_limits<std::size_t>::max());
+
+    // the lookup table must agree with a linear search of the size classes
+    // for every small size, and be usable at compile time
+    static_assert(Pool::selectSlab(1024) == 11);
+    static_assert(Pool::selectSlab(1025) == std::numeric_limits<std::size_t>::max());
+    for (std::size_t size = 1; size <= 1_KB; ++size)
+    {
+        auto expected = std::ranges::find_if(Pool::size_classes,
+                                             [size](std::size_t elem) { return size <= elem; });
+        EXPECT_EQ(pool.selectSlab(size),
+                  static_cast<std::size_t>(expected - Pool::size_classes.begin()));
+    }
 }
 
 
@@ -473,87 +942,997 @@ TEST(PoolTest, Alignment)
 }
 
 
-TEST(PoolTest, MultiThreadTest)
+TEST(AtomicSlabTest, AllocateItems)
 {
-    std::size_t const num_cores = std::thread::hardware_concurrency();
-    println("Detected {} hardware threads", num_cores);
-    ASSERT_GT(num_cores, 0u);
-    const std::size_t num_threads = num_cores * 8 / 10;
-
-    Pool pool;
-
-    constexpr int allocations_per_thread = 10000;
-
-    std::random_device rd;
+    AtomicSlab<128> slab;
+    const std::size_t per_slab = slab.getItemsPerSlab();
+    EXPECT_EQ(slab.getAllocatedMemory(), 0u);
 
-    auto worker = [&pool, &rd]() {
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<int> dist(0, 1000);
-        std::vector<std::byte*> items;
-        for (int i = 0; i < allocations_per_thread; ++i)
-        {
-            size_t size = 16 + dist(gen);
-            auto item = pool.allocate(size);
-            EXPECT_NE(item, nullptr);
-            items.push_back(item);
-        }
+    std::vector<std::byte*> items;
+    for (std::size_t i = 0; i < per_slab + 1; ++i)
+    {
+        items.push_back(slab.allocateItem(120));
+    }
+    EXPECT_EQ(std::set<std::byte*>(items.begin(), items.end()).size(), items.size());
+    EXPECT_EQ(slab.getAllocatedMemory(), 2 * slab.getAllocSize());
+
+    // a freed slot in the full first span is found again before the
+    // second span's free slots
+    slab.deallocateItem(items[5]);
+    EXPECT_EQ(slab.allocateItem(120), items[5]);
+
+    // bad pointers and double frees are caught by the atomic bitmap
+    EXPECT_THROW(slab.deallocateItem(items[0] + 8), std::invalid_argument);
+    slab.deallocateItem(items[0]);
+    EXPECT_THROW(slab.deallocateItem(items[0]), std::invalid_argument);
+    items.erase(items.begin());
+
+    slab.deallocateBatch(items);
+    std::vector<std::byte*> batch(per_slab);
+    EXPECT_EQ(slab.allocateBatch(128, batch), per_slab);
+    slab.deallocateBatch(batch);
+    EXPECT_EQ(slab.getAllocatedMemory(), 2 * slab.getAllocSize());
+}
 
-        for (auto it : items)
-        {
-            pool.deallocate(it);
-        }
-    };
 
+TEST(AtomicSlabTest, ConcurrentAllocation)
+{
+    // every thread allocates and frees in the same size class with no slab
+    // lock; each thread checks nobody else was handed its slots
+    AtomicSlab<64> slab;
+    constexpr int num_threads = 4;
+    constexpr std::size_t per_thread = 3000;
     std::vector<std::thread> threads;
-    for (size_t i = 0; i < num_threads; ++i)
+    std::atomic<int> failures{0};
+    for (int t = 0; t < num_threads; ++t)
     {
-        threads.emplace_back(worker);
+        threads.emplace_back([&slab, &failures, t]() {
+            std::vector<std::byte*> items;
+            for (int round = 0; round < 5; ++round)
+            {
+                for (std::size_t i = 0; i < per_thread; ++i)
+                {
+                    items.push_back(slab.allocateItem(64));
+                    std::memset(items.back(), t, 64);
+                }
+                for (auto item : items)
+                {
+                    if (item[0] != std::byte(t) || item[63] != std::byte(t))
+                    {
+                        ++failures;
+                    }
+                    slab.deallocateItem(item);
+                }
+                items.clear();
+            }
+        });
     }
-
     for (auto& t : threads)
     {
         t.join();
     }
+    EXPECT_EQ(failures.load(), 0);
+    EXPECT_LE(slab.getAllocatedMemory(),
+              ((num_threads * per_thread) / slab.getItemsPerSlab() + num_threads) * slab.getAllocSize());
 }
 
 
-TEST(SpinLockTest, BasicLocking)
+TEST(PoolTest, FreeListEngine)
 {
-    int counter = 0;
+    Pool::Config config;
+    config.slab_engine.fill(SlabEngine::freelist);
+    config.slab_engine[3] = SlabEngine::bitmap;
+    config.slab_engine[5] = SlabEngine::atomic_bitmap;
+    Pool pool(config);
 
-    SpinLock lock;
+    std::vector<std::byte*> items;
+    for (int i = 0; i < 4; ++i)
+    {
+        for (std::size_t size = 1; size <= 1100; size += 7)
+        {
+            auto item = pool.allocate(size);
+            EXPECT_NE(item, nullptr);
+            std::memset(item, 0xA5, size);
+            items.push_back(item);
+        }
+    }
 
-    ++counter;
-    lock.lock();
-    // critical section
-    EXPECT_EQ(++counter, 2);
-    lock.unlock();
+    for (auto it : items)
+    {
+        pool.deallocate(it);
+    }
+}
 
-    // try_lock should succeed when not locked
-    EXPECT_EQ(++counter, 3);
-    lock.try_lock();
-    // critical section
-    EXPECT_EQ(++counter, 4);
-    lock.unlock();
 
-    // lock again
-    EXPECT_EQ(++counter, 5);
-    lock.lock();
-    // critical section
-    EXPECT_EQ(++counter, 6);        
-    lock.unlock();
+TEST(PoolTest, Batch)
+{
+    Pool pool;
 
-    EXPECT_EQ(++counter, 7);
+    // a batch comes from as few spans as possible, slots in address order
+    std::vector<std::byte*> items(500);
+    pool.allocateBatch(64, items);
+    for (std::size_t i = 1; i < items.size(); ++i)
+    {
+        EXPECT_EQ(items[i] - items[i - 1], 64);
+    }
+    std::set<std::byte*> unique(items.begin(), items.end());
+    EXPECT_EQ(unique.size(), items.size());
+    for (auto item : items)
+    {
+        std::memset(item, 0x21, 64);
+    }
+    pool.deallocateBatch(items, 64);
+
+    // a single batch spanning several spans, reused after the free
+    std::vector<std::byte*> more(3000);
+    pool.allocateBatch(48, more);
+    EXPECT_EQ(std::set<std::byte*>(more.begin(), more.end()).size(), more.size());
+
+    // an unsized free sorts mixed sizes (and large blocks) into runs per
+    // slab and still reports a foreign pointer after freeing the rest
+    std::vector<std::byte*> mixed{pool.allocate(16), pool.allocate(16), pool.allocate(700),
+                                  pool.allocate(5000), pool.allocate(400000), pool.allocate(16)};
+    Pool other;
+    auto foreign = other.allocate(32);
+    mixed.insert(mixed.begin() + 3, foreign);
+    EXPECT_THROW(pool.deallocateBatch(mixed), std::invalid_argument);
+    other.deallocate(foreign);
+    pool.deallocateBatch(more);
 }
 
 
-//
-// NOTE: This test may occasionally fail due to timing issues. These are
-// clearly intentional race conditions with highly probabilistic outcomes.
-//
-TEST(SpinLockTest, Backoff)
+TEST(PoolTest, OverAligned)
 {
-    uint32_t tested_value = 0x55555555;
+    Pool pool;
+
+    // over-aligned requests come from classes whose slots are naturally
+    // aligned: 64-byte alignment for a 24-byte object means the 64 class
+    static_assert(Pool::selectSlab(24, 64) == Pool::selectSlab(64));
+    static_assert(Pool::selectSlab(200, 128) == Pool::selectSlab(256));
+    static_assert(Pool::selectSlab(16, 2_KB) == std::numeric_limits<std::size_t>::max());
+
+    std::vector<std::pair<std::byte*, std::size_t>> items;
+    for (std::size_t alignment = 1; alignment <= 4_KB; alignment *= 2)
+    {
+        for (std::size_t size : {1, 24, 100, 700, 2000, 300000})
+        {
+            auto item = pool.allocate(size, alignment);
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(item) % alignment, 0u)
+                << size << " bytes aligned to " << alignment;
+            std::memset(item, 0x5C, size);
+            if (size == 700)
+            {
+                pool.deallocate(item, size, alignment);
+            }
+            else
+            {
+                items.emplace_back(item, size);
+            }
+        }
+    }
+    for (auto [item, size] : items)
+    {
+        pool.deallocate(item);
+    }
+
+    EXPECT_THROW(pool.allocate(64, 3), std::invalid_argument);
+    EXPECT_THROW(pool.allocate(64, 8_KB), std::invalid_argument);
+
+    // small requests aligned beyond every class share page slots in spans
+    // instead of each mapping a block of their own
+    std::vector<std::byte*> pages;
+    std::vector<SpanHeader*> page_spans;
+    for (int i = 0; i < 64; ++i)
+    {
+        pages.push_back(pool.allocate(64, i % 2 ? 4_KB : 2_KB));
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(pages.back()) % 4_KB, 0u);
+        SpanHeader* span = PageMap::instance().lookup(pages.back());
+        ASSERT_NE(span, nullptr);
+        EXPECT_EQ(span->elem_size, 4_KB);
+        page_spans.push_back(span);
+    }
+    std::ranges::sort(page_spans);
+    EXPECT_LT(std::ranges::distance(page_spans.begin(), std::ranges::unique(page_spans).begin()), 8);
+    EXPECT_EQ(pool.reallocate(pages[1], 1000, 4_KB), pages[1]);
+    pages[3] = pool.reallocate(pages[3], 64);
+    EXPECT_EQ(PageMap::instance().lookup(pages[3])->elem_size, 64u);
+    pool.deallocate(pages[0], 64, 2_KB);
+    pool.deallocate(pages[1], 1000, 4_KB);
+    pool.deallocateBatch(std::span<std::byte* const>(pages).subspan(2, 30));
+    for (std::size_t i = 32; i < pages.size(); ++i)
+    {
+        pool.deallocate(pages[i]);
+    }
+
+    // over-aligned types through the smart pointer and allocator helpers
+    struct alignas(64) Counter
+    {
+        std::atomic<long> value{0};
+    };
+    auto counter = make_pool_unique<Counter>(pool);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(counter.get()) % 64, 0u);
+    auto counters = make_pool_unique<Counter[]>(pool, 10);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(counters.get()) % 64, 0u);
+
+    struct alignas(32) Vec8
+    {
+        float lanes[8];
+    };
+    std::vector<Vec8, PoolAllocator<Vec8>> vectors{PoolAllocator<Vec8>(pool)};
+    for (int i = 0; i < 100; ++i)
+    {
+        vectors.push_back(Vec8{});
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(vectors.data()) % 32, 0u);
+    }
+
+    std::basic_string<char, std::char_traits<char>, PoolAllocator<char>> text{PoolAllocator<char>(pool)};
+    text.assign(100, 'x');
+    EXPECT_EQ(text.size(), 100u);
+}
+
+
+TEST(PoolTest, Reallocate)
+{
+    Pool pool;
+
+    auto fill = [](std::byte* item, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            item[i] = std::byte(i * 7);
+        }
+    };
+    auto check = [](std::byte* item, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            if (item[i] != std::byte(i * 7))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // growing within the slot keeps the pointer
+    auto item = pool.reallocate(nullptr, 20);
+    fill(item, 20);
+    EXPECT_EQ(pool.reallocate(item, 32), item);
+    fill(item, 32);
+
+    // outgrowing it moves through the classes, then to SlabProxy
+    std::size_t size = 32;
+    for (std::size_t new_size : {100, 1000, 5000, 200000})
+    {
+        item = pool.reallocate(item, new_size);
+        EXPECT_TRUE(check(item, size)) << size << " -> " << new_size;
+        fill(item, new_size);
+        size = new_size;
+    }
+
+    // mapped blocks grow (and shrink) by remapping, keeping the contents
+    item = pool.reallocate(item, 1_MB);
+    EXPECT_TRUE(check(item, size));
+    fill(item, 1_MB);
+    item = pool.reallocate(item, 8_MB);
+    EXPECT_TRUE(check(item, 1_MB));
+    ASSERT_NE(PageMap::instance().lookup(item), nullptr);
+    EXPECT_GE(PageMap::instance().lookup(item)->elem_size, 8_MB);
+    item[8_MB - 1] = std::byte{1};
+    item = pool.reallocate(item, 512_KB);
+    EXPECT_TRUE(check(item, 512_KB));
+    EXPECT_LT(PageMap::instance().lookup(item)->elem_size, 1_MB);
+
+    // and shrink back into a slab
+    item = pool.reallocate(item, 40);
+    EXPECT_NE(PageMap::instance().lookup(item), nullptr);
+    EXPECT_EQ(PageMap::instance().lookup(item)->elem_size, 48u);
+    EXPECT_TRUE(check(item, 40));
+    pool.deallocate(item);
+
+    // an over-aligned reallocation keeps its alignment when it moves
+    item = pool.allocate(24, 64);
+    item = pool.reallocate(item, 300, 64);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(item) % 64, 0u);
+    pool.deallocate(item, 300, 64);
+
+    // shrinking into a smaller class moves the item, so a sized free with
+    // the new size returns it to the right slab
+    item = pool.allocate(64);
+    fill(item, 16);
+    auto shrunk = pool.reallocate(item, 16);
+    EXPECT_NE(shrunk, item);
+    EXPECT_EQ(PageMap::instance().lookup(shrunk)->elem_size, 16u);
+    EXPECT_TRUE(check(shrunk, 16));
+    pool.deallocate(shrunk, 16);
+    std::vector<std::byte*> small_items;
+    for (int i = 0; i < 100; ++i)
+    {
+        small_items.push_back(pool.allocate(16));
+        EXPECT_EQ(PageMap::instance().lookup(small_items.back())->elem_size, 16u);
+    }
+    for (auto small_item : small_items)
+    {
+        pool.deallocate(small_item, 16);
+    }
+    EXPECT_NO_THROW(pool.trim());
+}
+
+
+TEST(PoolTest, Headerless)
+{
+    Pool pool;
+
+    // small requests get the whole slot: consecutive 16-byte allocations
+    // come from neighbouring 16-byte slots
+    auto item1 = pool.allocate(16);
+    auto item2 = pool.allocate(16);
+    EXPECT_EQ(std::abs(item2 - item1), 16);
+    std::memset(item1, 0x5A, 16);
+
+    // 1 KB still fits a slab; only larger requests go to SlabProxy, which
+    // the page map knows nothing about
+    auto small = pool.allocate(1_KB);
+    auto large = pool.allocate(1_KB + 1);
+    ASSERT_NE(PageMap::instance().lookup(small), nullptr);
+    EXPECT_EQ(PageMap::instance().lookup(small)->elem_size, 1_KB);
+    EXPECT_EQ(PageMap::instance().lookup(large), nullptr);
+
+    // the address identifies the owning pool as well as the size class
+    Pool other;
+    EXPECT_THROW(other.deallocate(item1), std::invalid_argument);
+
+    for (auto item : {item1, item2, small, large})
+    {
+        pool.deallocate(item);
+    }
+}
+
+
+TEST(PoolTest, SizedDeallocate)
+{
+    Pool pool;
+
+    // a sized free lands in the same class the allocation came from
+    auto item = pool.allocate(24);
+    pool.deallocate(item, 24);
+    EXPECT_EQ(pool.allocate(30), item);
+    pool.deallocate(item, 30);
+
+    std::vector<std::pair<std::byte*, std::size_t>> items;
+    for (std::size_t size : {1, 16, 100, 1024, 1025, 5000, 32000})
+    {
+        items.emplace_back(pool.allocate(size), size);
+    }
+    for (auto [ptr, size] : items)
+    {
+        pool.deallocate(ptr, size);
+    }
+
+    // the STL allocator frees with the element count it allocated
+    std::vector<int, PoolAllocator<int>> values{PoolAllocator<int>(pool)};
+    for (int i = 0; i < 1000; ++i)
+    {
+        values.push_back(i);
+    }
+    EXPECT_EQ(values[999], 999);
+}
+
+
+TEST(PoolTest, LazySlabs)
+{
+    // constructing a slab or a pool creates no spans
+    Slab<64> slab;
+    FreeListSlab<64> freelist_slab;
+    EXPECT_EQ(slab.getAllocatedMemory(), 0u);
+    EXPECT_EQ(freelist_slab.getAllocatedMemory(), 0u);
+
+    auto item = slab.allocateItem(64);
+    EXPECT_EQ(slab.getAllocatedMemory(), 64_KB);
+    slab.deallocateItem(item);
+
+    // many idle pools are cheap: a few hundred bytes each, with large
+    // block caches and spans only created on use
+    EXPECT_LE(sizeof(Pool), 512u);
+    EXPECT_LE(sizeof(SlabProxy), 64u);
+    std::vector<std::unique_ptr<Pool>> pools;
+    for (int i = 0; i < 1000; ++i)
+    {
+        pools.push_back(std::make_unique<Pool>());
+    }
+    auto pool_item = pools.back()->allocate(64);
+    EXPECT_NE(pool_item, nullptr);
+    pools.back()->deallocate(pool_item);
+}
+
+
+TEST(PoolTest, CustomSizeClasses)
+{
+    // dense small classes plus a couple of large ones
+    using TunedPool = BasicPool<SizeClasses<16, 32, 48, 64, 80, 96, 112, 128, 4_KB, 32_KB>>;
+    static_assert(TunedPool::size_class_count == 10);
+    static_assert(TunedPool::selectSlab(80) == 4);
+    static_assert(TunedPool::selectSlab(129) == 8);
+    static_assert(TunedPool::selectSlab(32_KB) == 9);
+    static_assert(TunedPool::selectSlab(32_KB + 1) == std::numeric_limits<std::size_t>::max());
+
+    TunedPool pool;
+    auto item = pool.allocate(20000);
+    ASSERT_NE(PageMap::instance().lookup(item), nullptr);
+    EXPECT_EQ(PageMap::instance().lookup(item)->elem_size, 32_KB);
+    pool.deallocate(item);
+
+    // the smart pointer and allocator helpers work with any pool type
+    auto obj = make_pool_unique<std::pair<int, int>>(pool, 1, 2);
+    EXPECT_EQ(obj->second, 2);
+    auto shared = make_pool_shared<int[]>(pool, 10, 7);
+    EXPECT_EQ(shared[9], 7);
+    std::vector<int, PoolAllocator<int, TunedPool>> values{PoolAllocator<int, TunedPool>(pool)};
+    values.assign(5000, 3);
+    EXPECT_EQ(values.back(), 3);
+}
+
+TEST(PoolTest, PagePolicy)
+{
+    // every mode must work whether or not the system has huge pages;
+    // hugetlb falls back to normal pages when none are reserved
+    for (auto mode : {HugePages::off, HugePages::transparent, HugePages::hugetlb})
+    {
+        Pool::Config config;
+        config.page_policy.huge_pages = mode;
+        config.page_policy.prefault = (mode == HugePages::transparent);
+        Pool pool(config);
+
+        std::vector<std::byte*> items;
+        for (std::size_t size : {16, 256, 1024, 4000, 300000})
+        {
+            auto item = pool.allocate(size);
+            std::memset(item, 0xA5, size);
+            items.push_back(item);
+        }
+        for (auto item : items)
+        {
+            pool.deallocate(item);
+        }
+    }
+
+    EXPECT_EQ(PageAllocator::mappedSize(1, {}), 4_KB);
+    EXPECT_EQ(PageAllocator::mappedSize(1, {HugePages::hugetlb}), 2_MB);
+}
+
+
+TEST(PoolTest, MappedLargeBlocks)
+{
+    Pool pool;
+
+    // blocks from the mmap threshold up are mapped directly and registered
+    // in the page map, so both free paths recognize them
+    auto below = pool.allocate(SlabProxy::mmap_threshold - 1);
+    auto mapped = pool.allocate(1_MB);
+    EXPECT_EQ(PageMap::instance().lookup(below), nullptr);
+    ASSERT_NE(PageMap::instance().lookup(mapped), nullptr);
+    EXPECT_GE(PageMap::instance().lookup(mapped)->elem_size, 1_MB);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(mapped) % 16, 0u);
+    std::memset(mapped, 0x3C, 1_MB);
+
+    Pool other;
+    EXPECT_THROW(other.deallocate(mapped), std::invalid_argument);
+
+    pool.deallocate(below);
+    pool.deallocate(mapped, 1_MB);
+    EXPECT_EQ(PageMap::instance().lookup(mapped), nullptr);
+}
+
+TEST(PoolTest, LargeBlockCache)
+{
+    Pool pool;
+
+    // sizes are rounded up to whole pages (16-byte prefix included), and
+    // a freed block is handed straight back to the next request of its class
+    auto item = pool.allocate(20000);
+    std::memset(item, 0x5A, 20000);
+    pool.deallocate(item);
+    auto again = pool.allocate(18000);
+    EXPECT_EQ(again, item);
+
+    // growing within the class stays put
+    EXPECT_EQ(pool.reallocate(again, 20480 - 16), again);
+    pool.deallocate(again);
+
+    // the cache is bounded, and trim() gives back what it holds
+    std::vector<std::byte*> items;
+    for (int i = 0; i < 100; ++i)
+    {
+        items.push_back(pool.allocate(8_KB));
+    }
+    for (auto block : items)
+    {
+        pool.deallocate(block);
+    }
+    std::size_t released = pool.trim({std::chrono::milliseconds(0), 0});
+    EXPECT_GT(released, 0u);
+    EXPECT_LE(released, 256_KB + 20_KB);
+    EXPECT_EQ(pool.trim({std::chrono::milliseconds(0), 0}), 0u);
+}
+
+
+// true if the page holding `ptr` is backed by physical memory
+static bool isResident(const void* ptr)
+{
+    auto page = reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(ptr) & ~std::uintptr_t(4_KB - 1));
+    unsigned char vec = 0;
+    EXPECT_EQ(mincore(page, 4_KB, &vec), 0);
+    return vec & 1;
+}
+
+
+TEST(PoolTest, Trim)
+{
+    std::vector<std::byte*> items;
+    auto fill = [&items](Pool& pool) {
+        for (int i = 0; i < 1000; ++i)
+        {
+            items.push_back(pool.allocate(64));
+            std::memset(items.back(), 0x11, 64);
+        }
+    };
+    auto drain = [&items](Pool& pool) {
+        for (auto item : items)
+        {
+            pool.deallocate(item);
+        }
+    };
+
+    // explicit trim, including the calling thread's cached slots
+    {
+        Pool pool;
+        fill(pool);
+        auto probe = items[500];
+        drain(pool);
+        EXPECT_TRUE(isResident(probe));
+        EXPECT_GT(pool.trim({std::chrono::milliseconds(0), 0}), 0u);
+        EXPECT_FALSE(isResident(probe));
+        items.clear();
+
+        // and the pool carries on as before
+        fill(pool);
+        drain(pool);
+        items.clear();
+    }
+
+    // background scavenger
+    {
+        Pool::Config config;
+        config.thread_cache_depth.fill(0);
+        config.trim_policy = {std::chrono::milliseconds(0), 0};
+        config.scavenge_interval = std::chrono::milliseconds(5);
+        Pool pool(config);
+        fill(pool);
+        auto probe = items[500];
+        drain(pool);
+        for (int i = 0; i < 400 && isResident(probe); ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        EXPECT_FALSE(isResident(probe));
+        items.clear();
+    }
+}
+
+
+TEST(PoolTest, AllocateZeroed)
+{
+    auto is_zero = [](const std::byte* item, std::size_t size) {
+        return std::all_of(item, item + size, [](std::byte b) { return b == std::byte{0}; });
+    };
+
+    Pool::Config config;
+    config.thread_cache_depth.fill(0);
+    Pool pool(config);
+
+    // never-used slots come straight from fresh pages and aren't touched
+    std::vector<std::byte*> items;
+    for (int i = 0; i < 600; ++i)
+    {
+        items.push_back(pool.allocateZeroed(64));
+    }
+    EXPECT_FALSE(isResident(items.back()));
+    for (auto item : items)
+    {
+        EXPECT_TRUE(is_zero(item, 64));
+        std::memset(item, 0x5a, 64);
+    }
+
+    // recycled slots are cleared
+    for (auto item : items)
+    {
+        pool.deallocate(item);
+    }
+    for (auto& item : items)
+    {
+        item = pool.allocateZeroed(64);
+        EXPECT_TRUE(is_zero(item, 64));
+    }
+    for (auto item : items)
+    {
+        pool.deallocate(item);
+    }
+
+    // large blocks, mapped and not
+    auto big = pool.allocateZeroed(8_MB);
+    EXPECT_FALSE(isResident(big + 4_MB));
+    EXPECT_TRUE(is_zero(big, 8_MB));
+    pool.deallocate(big);
+
+    auto medium = pool.allocate(5000);
+    std::memset(medium, 0x5a, 5000);
+    pool.deallocate(medium);
+    medium = pool.allocateZeroed(5000);
+    EXPECT_TRUE(is_zero(medium, 5000));
+    pool.deallocate(medium);
+
+    auto aligned = pool.allocateZeroed(64_KB, 4_KB);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(aligned) % 4_KB, 0u);
+    EXPECT_TRUE(is_zero(aligned, 64_KB));
+    pool.deallocate(aligned);
+
+    // with the default thread cache, refilled slots stay fresh until they
+    // are handed out, and slots freed into the cache are cleared
+    Pool cached_pool;
+    ASSERT_EQ(cached_pool.getCacheMode(), CacheMode::per_thread);
+    for (int i = 0; i < 40; ++i)
+    {
+        items[i] = cached_pool.allocateZeroed(1_KB);
+    }
+    EXPECT_FALSE(isResident(items[39]));
+    for (int i = 0; i < 40; ++i)
+    {
+        EXPECT_TRUE(is_zero(items[i], 1_KB));
+        std::memset(items[i], 0x5a, 1_KB);
+    }
+    for (int i = 0; i < 40; ++i)
+    {
+        cached_pool.deallocate(items[i]);
+    }
+    for (int i = 0; i < 40; ++i)
+    {
+        items[i] = cached_pool.allocateZeroed(1_KB);
+        EXPECT_TRUE(is_zero(items[i], 1_KB));
+    }
+    for (int i = 0; i < 40; ++i)
+    {
+        cached_pool.deallocate(items[i]);
+    }
+    // fresh slots flushed back unused are handed out again correctly
+    EXPECT_NO_THROW(cached_pool.trim());
+}
+
+
+TEST(PoolTest, MultiThreadTest)
+{
+    std::size_t const num_cores = std::thread::hardware_concurrency();
+    println("Detected {} hardware threads", num_cores);
+    ASSERT_GT(num_cores, 0u);
+    const std::size_t num_threads = num_cores * 8 / 10;
+
+    Pool pool;
+
+    constexpr int allocations_per_thread = 10000;
+
+    std::random_device rd;
+
+    auto worker = [&pool, &rd]() {
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<int> dist(0, 1000);
+        std::vector<std::byte*> items;
+        for (int i = 0; i < allocations_per_thread; ++i)
+        {
+            size_t size = 16 + dist(gen);
+            auto item = pool.allocate(size);
+            EXPECT_NE(item, nullptr);
+            items.push_back(item);
+        }
+
+        for (auto it : items)
+        {
+            pool.deallocate(it);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+}
+
+
+TEST(PoolTest, ThreadCache)
+{
+    Pool pool;
+    EXPECT_EQ(pool.getThreadCacheDepth(0), 64u);
+    EXPECT_EQ(pool.getThreadCacheDepth(11), 8u);
+
+    // a free followed by an allocation of the same class is served LIFO
+    // from this thread's cache
+    auto item1 = pool.allocate(100);
+    pool.deallocate(item1);
+    auto item2 = pool.allocate(100);
+    EXPECT_EQ(item1, item2);
+    pool.deallocate(item2);
+
+    // slots cached by a thread are flushed back to the slab at thread exit
+    std::byte* thread_item = nullptr;
+    std::thread t([&pool, &thread_item]() {
+        thread_item = pool.allocate(200);
+        pool.deallocate(thread_item);
+    });
+    t.join();
+
+    std::vector<std::byte*> items;
+    for (std::size_t i = 0; i < pool.getThreadCacheDepth(pool.selectSlab(200)); ++i)
+    {
+        items.push_back(pool.allocate(200));
+    }
+    EXPECT_NE(std::ranges::find(items, thread_item), items.end());
+    for (auto it : items)
+    {
+        pool.deallocate(it);
+    }
+
+    // caching disabled for every class
+    Pool::Config config;
+    config.thread_cache_depth.fill(0);
+    Pool uncached(config);
+    auto item3 = uncached.allocate(100);
+    EXPECT_NE(item3, nullptr);
+    uncached.deallocate(item3);
+}
+
+
+TEST(PoolTest, ThreadCacheOutlivesPool)
+{
+    auto pool = std::make_unique<Pool>();
+
+    std::atomic<bool> pool_used{false};
+    std::atomic<bool> pool_destroyed{false};
+    std::thread t([&]() {
+        pool->deallocate(pool->allocate(64));
+        pool_used = true;
+        while (!pool_destroyed)
+        {
+            std::this_thread::yield();
+        }
+        // thread exit must not flush into the destroyed pool's slabs
+    });
+
+    while (!pool_used)
+    {
+        std::this_thread::yield();
+    }
+    pool.reset();
+    pool_destroyed = true;
+    t.join();
+}
+
+
+TEST(PoolTest, PerCpuCache)
+{
+    Pool::Config config;
+    config.cache_mode = CacheMode::per_cpu;
+    auto pool = std::make_unique<Pool>(config);
+    EXPECT_EQ(pool->getCacheMode(), PerCpuCache::supported() ? CacheMode::per_cpu : CacheMode::none);
+
+    // many short-lived threads share the per-CPU bins; the cache stays a
+    // fixed size however many threads there are
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 16; ++t)
+    {
+        threads.emplace_back([&pool, t] {
+            std::vector<std::byte*> items;
+            for (int i = 0; i < 2000; ++i)
+            {
+                std::size_t size = 16 + (i + t) % 64 * 16;
+                items.push_back(pool->allocate(size));
+                std::memset(items.back(), t, size);
+                if (i % 3 == 0)
+                {
+                    pool->deallocate(items.back());
+                    items.pop_back();
+                }
+            }
+            for (auto item : items)
+            {
+                pool->deallocate(item);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // flushing the CPU bins leaves every slab empty
+    pool->trim({std::chrono::milliseconds(0), 0});
+    auto item = pool->allocate(64);
+    pool->deallocate(item);
+
+    // slots still cached at destruction are simply dropped
+    pool.reset();
+
+    config.cache_mode = CacheMode::none;
+    Pool uncached(config);
+    EXPECT_EQ(uncached.getCacheMode(), CacheMode::none);
+    item = uncached.allocate(64);
+    uncached.deallocate(item);
+    EXPECT_EQ(uncached.allocate(64), item);
+    uncached.deallocate(item);
+}
+
+
+TEST(PoolTest, Stats)
+{
+    Pool::Config config;
+    config.collect_stats = true;
+    Pool pool(config);
+
+    auto index = pool.selectSlab(100);
+    std::vector<std::byte*> items;
+    for (int i = 0; i < 10; ++i)
+    {
+        items.push_back(pool.allocate(100));
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        pool.deallocate(items.back());
+        items.pop_back();
+    }
+    auto small_block = pool.allocate(8_KB);
+    auto mapped_block = pool.allocate(512_KB);
+    pool.deallocate(small_block);
+
+    auto stats = pool.stats();
+    const auto& entry = stats.size_classes[index];
+    EXPECT_EQ(entry.elem_size, Pool::size_classes[index]);
+    EXPECT_EQ(entry.allocations, 10u);
+    EXPECT_EQ(entry.frees, 4u);
+    EXPECT_EQ(entry.requested_bytes, 1000u);
+    EXPECT_EQ(entry.live_items, 6u);
+    // the freed slots sit in this thread's cache, along with the rest
+    // of its refill
+    EXPECT_GE(entry.cached_items, 4u);
+    EXPECT_EQ(entry.span_count, 1u);
+    EXPECT_EQ(entry.live_items + entry.cached_items + entry.free_slots,
+              Slab<128>::getItemsPerSlab());
+    EXPECT_GT(entry.reserved_bytes, 0u);
+    EXPECT_GE(entry.peak_reserved_bytes, entry.reserved_bytes);
+    EXPECT_EQ(stats.size_classes[0].allocations, 0u);
+    EXPECT_EQ(stats.size_classes[0].reserved_bytes, 0u);
+
+    EXPECT_EQ(stats.large.allocations, 2u);
+    EXPECT_EQ(stats.large.frees, 1u);
+    EXPECT_EQ(stats.large.live_items, 1u);
+    EXPECT_EQ(stats.large.cached_items, 1u);
+    EXPECT_GE(stats.large.reserved_bytes, 512_KB + 8_KB);
+
+    // counts of threads that have exited are kept
+    std::thread t([&pool]() {
+        pool.deallocate(pool.allocate(32));
+    });
+    t.join();
+    stats = pool.stats();
+    EXPECT_EQ(stats.size_classes[pool.selectSlab(32)].allocations, 1u);
+    EXPECT_EQ(stats.size_classes[pool.selectSlab(32)].frees, 1u);
+
+    // null entries in a batch free are skipped, not counted
+    for (std::size_t size : {200, 300})
+    {
+        std::vector<std::byte*> batch(4);
+        pool.allocateBatch(size, batch);
+        batch.insert(batch.begin(), nullptr);
+        batch.insert(batch.begin() + 3, nullptr);
+        batch.push_back(nullptr);
+        if (size == 200)
+        {
+            pool.deallocateBatch(batch);
+        }
+        else
+        {
+            pool.deallocateBatch(batch, size);
+        }
+        stats = pool.stats();
+        EXPECT_EQ(stats.size_classes[pool.selectSlab(size)].allocations, 4u);
+        EXPECT_EQ(stats.size_classes[pool.selectSlab(size)].frees, 4u);
+        EXPECT_EQ(stats.large.frees, 1u);
+    }
+
+    // a rejected free isn't counted; a remapped block counts as a new
+    // block of its new size and a free of the old one
+    auto page_item = pool.allocate(64, 4_KB);
+    pool.deallocate(page_item);
+    EXPECT_THROW(pool.deallocate(page_item), std::invalid_argument);
+    mapped_block = pool.reallocate(mapped_block, 1_MB);
+    stats = pool.stats();
+    EXPECT_EQ(stats.large.allocations, 4u);
+    EXPECT_EQ(stats.large.frees, 3u);
+    EXPECT_EQ(stats.large.requested_bytes, 8_KB + 512_KB + 64 + 1_MB);
+
+    for (auto item : items)
+    {
+        pool.deallocate(item);
+    }
+    pool.deallocate(mapped_block);
+    stats = pool.stats();
+    EXPECT_EQ(stats.size_classes[index].live_items, 0u);
+    EXPECT_EQ(stats.large.live_items, 0u);
+    // the cached 8 KB block and the page slab's (now empty) span
+    EXPECT_EQ(stats.large.span_count, 2u);
+    EXPECT_LT(stats.large.reserved_bytes, 512_KB);
+    EXPECT_GE(stats.large.peak_reserved_bytes, 1_MB + 8_KB);
+
+    // without counters, the slab figures are still reported and cached
+    // slots count as live; batches bypass the cache entirely
+    Pool::Config plain_config;
+    plain_config.cache_mode = CacheMode::none;
+    plain_config.slab_engine.fill(SlabEngine::atomic_bitmap);
+    plain_config.slab_engine[1] = SlabEngine::freelist;
+    Pool plain(plain_config);
+    std::vector<std::byte*> batch(20);
+    plain.allocateBatch(32, batch);
+    auto item = plain.allocate(64);
+    auto plain_stats = plain.stats();
+    EXPECT_EQ(plain_stats.size_classes[1].live_items, 20u);
+    EXPECT_EQ(plain_stats.size_classes[1].allocations, 0u);
+    EXPECT_EQ(plain_stats.size_classes[3].live_items, 1u);
+    EXPECT_EQ(plain_stats.size_classes[3].span_count, 1u);
+    plain.deallocateBatch(batch);
+    plain.deallocate(item);
+    plain_stats = plain.stats();
+    EXPECT_EQ(plain_stats.size_classes[1].live_items, 0u);
+    EXPECT_EQ(plain_stats.size_classes[3].live_items, 0u);
+}
+
+
+TEST(SpinLockTest, BasicLocking)
+{
+    int counter = 0;
+
+    SpinLock lock;
+
+    ++counter;
+    lock.lock();
+    // critical section
+    EXPECT_EQ(++counter, 2);
+    lock.unlock();
+
+    // try_lock should succeed when not locked
+    EXPECT_EQ(++counter, 3);
+    lock.try_lock();
+    // critical section
+    EXPECT_EQ(++counter, 4);
+    lock.unlock();
+
+    // lock again
+    EXPECT_EQ(++counter, 5);
+    lock.lock();
+    // critical section
+    EXPECT_EQ(++counter, 6);        
+    lock.unlock();
+
+    EXPECT_EQ(++counter, 7);
+}
+
+
+//
+// NOTE: This test may occasionally fail due to timing issues. These are
+// clearly intentional race conditions with highly probabilistic outcomes.
+//
+TEST(SpinLockTest, Backoff)
+{
+    uint32_t tested_value = 0x55555555;
 
     SpinLock lock;
 
@@ -661,6 +2040,33 @@ TEST(SpinLockTest, LockContention)
 }
 
 
+TEST(SpinLockTest, Parking)
+{
+    SpinLock lock;
+    lock.lock();
+
+    // A waiter blocked for a long time parks rather than spinning or
+    // sleeping, so it burns almost no CPU and wakes as soon as the lock is
+    // released
+    std::chrono::steady_clock::time_point acquired;
+    timespec cpu{};
+    std::thread t([&]() {
+        lock.lock();
+        acquired = std::chrono::steady_clock::now();
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        lock.unlock();
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    auto released = std::chrono::steady_clock::now();
+    lock.unlock();
+    t.join();
+
+    EXPECT_LT(acquired - released, std::chrono::milliseconds(50));
+    EXPECT_LT(cpu.tv_sec * 1000 + cpu.tv_nsec / 1000000, 50);
+}
+
+
 TEST(SpinLockTest, MultipleThreads)
 {
     constexpr int num_threads = 10;
@@ -809,6 +2215,145 @@ TEST(SpinLockTest, ManyThreads)
 }
 
 
+// Mutual exclusion, try_lock, and first-come first-served hand-off
+template<Lockable LockType>
+static void checkQueueLock()
+{
+    LockType lock;
+
+    EXPECT_TRUE(lock.try_lock());
+    EXPECT_FALSE(lock.try_lock());
+
+    // waiters queued one at a time get the lock in arrival order, however
+    // the scheduler wakes them
+    constexpr int num_waiters = 4;
+    std::vector<int> order;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_waiters; ++i)
+    {
+        threads.emplace_back([&lock, &order, i]() {
+            std::scoped_lock<LockType> guard(lock);
+            order.push_back(i);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    lock.unlock();
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3}));
+
+    // nested with another lock of the same type
+    LockType other;
+    {
+        std::scoped_lock<LockType, LockType> guard(lock, other);
+        EXPECT_FALSE(lock.try_lock());
+        EXPECT_FALSE(other.try_lock());
+    }
+
+    int counter = 0;
+    threads.clear();
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&lock, &counter]() {
+            for (int i = 0; i < 10000; ++i)
+            {
+                std::scoped_lock<LockType> guard(lock);
+                ++counter;
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    EXPECT_EQ(counter, 40000);
+}
+
+
+TEST(SpinLockTest, QueueLocks)
+{
+    checkQueueLock<TicketLock>();
+    checkQueueLock<McsLock>();
+
+    // and the pool runs on either
+    BasicPool<DefaultSizeClasses, McsLock> pool;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&pool]() {
+            std::vector<std::byte*> items;
+            for (int i = 0; i < 2000; ++i)
+            {
+                items.push_back(pool.allocate(16 + i % 1000));
+            }
+            for (auto item : items)
+            {
+                pool.deallocate(item);
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    Slab<64, TicketLock> slab;
+    auto item = slab.allocateItem(64);
+    slab.deallocateItem(item);
+}
+
+
+TEST(SpinLockTest, Stats)
+{
+    auto total = [](const auto& histogram) {
+        return std::accumulate(histogram.begin(), histogram.end(), uint64_t{0});
+    };
+
+    InstrumentedSpinLock lock;
+    lock.lock();
+    EXPECT_FALSE(lock.try_lock());
+
+    // a waiter held off for 50 ms spins, then parks
+    std::thread t([&lock]() {
+        std::scoped_lock<InstrumentedSpinLock> guard(lock);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    lock.unlock();
+    t.join();
+
+    auto stats = lock.stats();
+    EXPECT_EQ(stats.acquisitions, 2u);
+    EXPECT_EQ(stats.contended, 1u);
+    EXPECT_EQ(stats.failed_try_locks, 1u);
+    EXPECT_GE(stats.parks, 1u);
+    EXPECT_GT(stats.spins, 0u);
+    EXPECT_EQ(total(stats.wait_ns), 1u);
+    // 50 ms is about 2^25.6 ns
+    EXPECT_EQ(std::accumulate(stats.wait_ns.begin() + 24, stats.wait_ns.end(), uint64_t{0}), 1u);
+    EXPECT_EQ(total(stats.hold_ns), 2u);
+
+    // the pool reports its slabs' locks per size class
+    BasicPool<DefaultSizeClasses, InstrumentedSpinLock>::Config config;
+    config.thread_cache_depth.fill(0);
+    BasicPool<DefaultSizeClasses, InstrumentedSpinLock> pool(config);
+    for (int i = 0; i < 10; ++i)
+    {
+        pool.deallocate(pool.allocate(64));
+    }
+    auto pool_stats = pool.lockStats();
+    auto slab_index = pool.selectSlab(64);
+    EXPECT_EQ(pool_stats[slab_index].acquisitions, 20u);
+    EXPECT_EQ(total(pool_stats[slab_index].hold_ns), 20u);
+    EXPECT_EQ(pool_stats[pool.selectSlab(128)].acquisitions, 0u);
+
+#ifndef SPALLOC_LOCK_STATS
+    // and the default lock keeps nothing
+    EXPECT_EQ(Pool().lockStats()[slab_index].acquisitions, 0u);
+#endif
+}
+
+
 TEST(LifetimeObserverTest, SimpleObjectOwnership)
 {
     class TestObject: public LifetimeObserver